@@ -0,0 +1,143 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#define ARENABLOCK (16UL << 20) // a multiple of the huge page size
+#define HUGEPAGE (2UL << 20)
+
+arena::arena():current(NULL),total(0)
+    {
+    }
+
+arena::~arena()
+    {
+    release();
+    }
+
+arena::block * arena::newBlock(size_t size)
+    {
+    void * memory;
+#if defined(__linux__)
+    size = (size + HUGEPAGE - 1) & ~(HUGEPAGE - 1);
+    memory = mmap(NULL,size,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+    if(memory == MAP_FAILED)
+        memory = NULL;
+#if defined(MADV_HUGEPAGE)
+    else
+        madvise(memory,size,MADV_HUGEPAGE);
+#endif
+#else
+    memory = malloc(size);
+#endif
+    if(memory == NULL)
+        {
+        fprintf(stderr,"Cannot allocate %lu bytes\n",(unsigned long)size);
+        exit(-15);
+        }
+    block * b = (block *)memory;
+    b->previous = NULL;
+    b->size = size;
+    b->used = sizeof(block);
+    total += size;
+    return b;
+    }
+
+void * arena::allocate(size_t size,size_t alignment)
+    {
+    if(current)
+        {
+        size_t start = (current->used + alignment - 1) & ~(alignment - 1);
+        if(start + size <= current->size)
+            {
+            current->used = start + size;
+            return (char *)current + start;
+            }
+        }
+    size_t needed = ((sizeof(block) + alignment - 1) & ~(alignment - 1)) + size;
+    block * b;
+    if(needed > ARENABLOCK / 4 && current)
+        {
+        // A block of its own, behind the current one, which may still have
+        // room for smaller requests.
+        b = newBlock(needed);
+        b->previous = current->previous;
+        current->previous = b;
+        }
+    else
+        {
+        b = newBlock(needed > ARENABLOCK ? needed : ARENABLOCK);
+        b->previous = current;
+        current = b;
+        }
+    size_t start = (b->used + alignment - 1) & ~(alignment - 1);
+    b->used = start + size;
+    return (char *)b + start;
+    }
+
+void arena::release()
+    {
+    while(current)
+        {
+        block * previous = current->previous;
+#if defined(__linux__)
+        munmap(current,current->size);
+#else
+        free(current);
+#endif
+        current = previous;
+        }
+    total = 0;
+    }
+
+void arena::reset()
+    {
+    block * keep = NULL;
+    while(current)
+        {
+        block * previous = current->previous;
+        if(!keep && current->size == ARENABLOCK)
+            keep = current;
+        else
+            {
+#if defined(__linux__)
+            munmap(current,current->size);
+#else
+            free(current);
+#endif
+            }
+        current = previous;
+        }
+    total = 0;
+    if(keep)
+        {
+        keep->previous = NULL;
+        keep->used = sizeof(block);
+        total = keep->size;
+        }
+    current = keep;
+    }
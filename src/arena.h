@@ -0,0 +1,66 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+
+/* Monotonic allocator. Memory is handed out from large blocks, backed by huge
+pages where the system has them, and is only given back all at once, by
+release() or the destructor. Destructors of objects in an arena are never
+called. An arena must not be used by more than one thread at a time. */
+class arena
+    {
+    struct block
+        {
+        block * previous;
+        size_t size; // including this header
+        size_t used; // including this header
+        };
+    block * current;
+    size_t total; // bytes in all blocks
+    block * newBlock(size_t size);
+public:
+    arena();
+    arena(const arena &) = delete;
+    arena & operator=(const arena &) = delete;
+    ~arena();
+    void * allocate(size_t size,size_t alignment = alignof(std::max_align_t));
+    template <class T> T * newArray(size_t n) // like new T[n]
+        {
+        T * array = (T *)allocate(n * sizeof(T),alignof(T));
+        for(size_t i = 0;i < n;++i)
+            new(array + i) T;
+        return array;
+        }
+    void release();
+    void reset(); // like release(), but keeps a block for reuse
+    size_t size() const
+        {
+        return total;
+        }
+    };
+
+#endif
@@ -0,0 +1,136 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "batch.h"
+#include "repetitions.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+static FILE * Manifest;
+static FILE * Out;
+static std::mutex manifestLock;
+static std::mutex outLock;
+
+/* The next path in the manifest, or NULL. The caller frees it. */
+static char * nextPath()
+    {
+    std::lock_guard<std::mutex> lock(manifestLock);
+    char * line = NULL;
+    size_t size = 0;
+    while(getline(&line,&size,Manifest) >= 0)
+        {
+        line[strcspn(line,"\r\n")] = '\0';
+        if(*line)
+            return line;
+        }
+    free(line);
+    return NULL;
+    }
+
+static char * readWholeFile(const char * path,size_t & length)
+    {
+    FILE * fp = fopen(path,"rb");
+    if(!fp)
+        return NULL;
+    size_t capacity = 65536;
+    char * text = (char *)malloc(capacity);
+    size_t n;
+    length = 0;
+    while(text && (n = fread(text + length,1,capacity - length,fp)) > 0)
+        {
+        length += n;
+        if(length == capacity)
+            text = (char *)realloc(text,capacity *= 2);
+        }
+    fclose(fp);
+    return text;
+    }
+
+static void analyse(const char * path)
+    {
+    textInput input;
+    input.name = path;
+    input.text = readWholeFile(path,input.length);
+    if(!input.text)
+        {
+        std::lock_guard<std::mutex> lock(outLock);
+        fprintf(Out,"%s\tERROR\tcannot read\n",path);
+        return;
+        }
+    double repetitiveness = ComputeRepetitiveness(&input,1,NULL);
+    char record[BATCHPHRASES * 1024];
+    size_t len = snprintf(record,sizeof(record),"%s\t%f\t%s\t%lu\t%lu",path,repetitiveness,repetitivenessIsApproximate() ? "lower-bound" : "exact",(unsigned long)GetFiducialTextLength(),(unsigned long)GetReducedTextLength());
+    char words[1000];
+    unsigned long count;
+    for(unsigned long rank = 0;rank < BATCHPHRASES && (count = GetRepeatedPhrase(rank,words,sizeof(words))) > 0;++rank)
+        {
+        int n = snprintf(record + len,sizeof(record) - len,"\t%lu\t%s",count,words);
+        if(n < 0 || (size_t)n >= sizeof(record) - len)
+            break;
+        len += n;
+        }
+    EndAnalysis();
+    free((void *)input.text);
+    std::lock_guard<std::mutex> lock(outLock);
+    fprintf(Out,"%.*s\n",(int)len,record);
+    fflush(Out);
+    }
+
+/* Each worker has an analysis of its own, which keeps its memory from one
+file to the next. */
+static void work()
+    {
+    analysis * A = NewAnalysis();
+    UseAnalysis(A);
+    setVersionComparison(false);
+    char * path;
+    while((path = nextPath()) != NULL)
+        {
+        analyse(path);
+        free(path);
+        }
+    UseAnalysis(NULL);
+    DeleteAnalysis(A);
+    }
+
+int batch(const char * manifest,FILE * out)
+    {
+    Manifest = strcmp(manifest,"-") ? fopen(manifest,"r") : stdin;
+    if(!Manifest)
+        {
+        fprintf(stderr,"Cannot open %s for reading\n",manifest);
+        return 1;
+        }
+    Out = out;
+    // The workers run as the slices of a parallelFor, so that the analyses
+    // do not start threads of their own.
+    parallelFor(numberOfThreads(),1,[](unsigned long,unsigned long)
+        {
+        work();
+        });
+    if(Manifest != stdin)
+        fclose(Manifest);
+    fflush(Out);
+    return 0;
+    }
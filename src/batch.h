@@ -0,0 +1,47 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+#define BATCHPHRASES 10 // repeated phrases per result record
+
+/* Analyses each of the files listed in manifest ("-": standard input), one
+path per line, on its own, with the settings of the default analysis. The
+files are analysed concurrently by numberOfThreads() workers. For each file
+a line is written to out as soon as it is done, with tab separated
+
+    <path> <repetitiveness> <bound> <fiducial text length> <reduced text length>
+
+followed by the count and the words of each of the at most BATCHPHRASES
+highest ranked repeated phrases. <bound> is "exact", or "lower-bound" if -k
+left phrases uncounted, in which case the repetitiveness is a lower bound.
+An error gives
+
+    <path> ERROR <message>
+
+Returns the exit code. */
+int batch(const char * manifest,FILE * out);
+
+#endif
@@ -0,0 +1,285 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "compress.h"
+#include <string.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+bool parseCompression(const char * name,compression & method)
+    {
+#if HAVE_ZLIB
+    if(!strcmp(name,"gzip"))
+        {
+        method = gzipCompression;
+        return true;
+        }
+#endif
+#if HAVE_ZSTD
+    if(!strcmp(name,"zstd"))
+        {
+        method = zstdCompression;
+        return true;
+        }
+#endif
+    return false;
+    }
+
+const char * compressionSuffix(compression method)
+    {
+    switch(method)
+        {
+        case gzipCompression:
+            return ".gz";
+        case zstdCompression:
+            return ".zst";
+        default:
+            return "";
+        }
+    }
+
+#if HAVE_ZLIB || HAVE_ZSTD
+
+typedef std::vector<char> chunk;
+
+/* The cookie of a compressing stream. The writer fills chunks, the thread
+compresses them in turn. An empty chunk ends the data. */
+class compressor
+    {
+    FILE * fp;
+    compression method;
+    chunk current;
+    std::mutex queueLock;
+    std::condition_variable queueChanged;
+    std::deque<chunk> queue;
+    bool good; // written by the thread until it is joined
+    std::thread worker;
+#if HAVE_ZLIB
+    z_stream z;
+#endif
+#if HAVE_ZSTD
+    ZSTD_CCtx * zstd;
+#endif
+    char out[1 << 16];
+    void write(size_t n)
+        {
+        if(n > 0 && fwrite(out,1,n,fp) != n)
+            good = false;
+        }
+    void compress(const chunk & data,bool last);
+    void run();
+public:
+    compressor(FILE * fp,compression method);
+    ~compressor();
+    void put(const char * s,size_t n);
+    bool close();
+    };
+
+compressor::compressor(FILE * fp,compression method):fp(fp),method(method),good(true)
+    {
+#if HAVE_ZLIB
+    memset(&z,0,sizeof(z));
+    if(method == gzipCompression && deflateInit2(&z,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15 + 16,8,Z_DEFAULT_STRATEGY) != Z_OK)
+        good = false;
+#endif
+#if HAVE_ZSTD
+    zstd = method == zstdCompression ? ZSTD_createCCtx() : NULL;
+    if(method == zstdCompression && !zstd)
+        good = false;
+#endif
+    current.reserve(COMPRESSIONCHUNK);
+    worker = std::thread([this]()
+        {
+        run();
+        });
+    }
+
+compressor::~compressor()
+    {
+#if HAVE_ZLIB
+    if(method == gzipCompression)
+        deflateEnd(&z);
+#endif
+#if HAVE_ZSTD
+    ZSTD_freeCCtx(zstd);
+#endif
+    }
+
+void compressor::compress(const chunk & data,bool last)
+    {
+    if(!good)
+        return;
+#if HAVE_ZLIB
+    if(method == gzipCompression)
+        {
+        z.next_in = (Bytef *)data.data();
+        z.avail_in = (uInt)data.size();
+        int result;
+        do
+            {
+            z.next_out = (Bytef *)out;
+            z.avail_out = sizeof(out);
+            result = deflate(&z,last ? Z_FINISH : Z_NO_FLUSH);
+            write(sizeof(out) - z.avail_out);
+            }
+        while(good && (last ? result == Z_OK || result == Z_BUF_ERROR : z.avail_out == 0));
+        if(result == Z_STREAM_ERROR || (last && result != Z_STREAM_END))
+            good = false;
+        }
+#endif
+#if HAVE_ZSTD
+    if(method == zstdCompression)
+        {
+        ZSTD_inBuffer in = {data.data(),data.size(),0};
+        size_t left;
+        do
+            {
+            ZSTD_outBuffer o = {out,sizeof(out),0};
+            left = ZSTD_compressStream2(zstd,&o,&in,last ? ZSTD_e_end : ZSTD_e_continue);
+            if(ZSTD_isError(left))
+                {
+                good = false;
+                return;
+                }
+            write(o.pos);
+            }
+        while(good && (last ? left != 0 : in.pos < in.size));
+        }
+#endif
+    }
+
+void compressor::run()
+    {
+    for(;;)
+        {
+        chunk data;
+            {
+            std::unique_lock<std::mutex> lock(queueLock);
+            while(queue.empty())
+                queueChanged.wait(lock);
+            data.swap(queue.front());
+            queue.pop_front();
+            queueChanged.notify_one();
+            }
+        bool last = data.empty();
+        compress(data,last);
+        if(last)
+            return;
+        }
+    }
+
+void compressor::put(const char * s,size_t n)
+    {
+    while(n > 0)
+        {
+        size_t room = COMPRESSIONCHUNK - current.size();
+        size_t m = n < room ? n : room;
+        current.insert(current.end(),s,s + m);
+        s += m;
+        n -= m;
+        if(current.size() == COMPRESSIONCHUNK)
+            {
+            std::unique_lock<std::mutex> lock(queueLock);
+            while(queue.size() >= COMPRESSIONQUEUE)
+                queueChanged.wait(lock);
+            queue.push_back(chunk());
+            queue.back().swap(current);
+            queueChanged.notify_one();
+            lock.unlock();
+            current.reserve(COMPRESSIONCHUNK);
+            }
+        }
+    }
+
+bool compressor::close()
+    {
+        {
+        std::lock_guard<std::mutex> lock(queueLock);
+        if(!current.empty())
+            queue.push_back(std::move(current));
+        queue.push_back(chunk()); // the end
+        queueChanged.notify_one();
+        }
+    worker.join();
+    bool ok = good;
+    if(fp == stdout)
+        {
+        if(fflush(fp) != 0)
+            ok = false;
+        }
+    else if(fclose(fp) != 0)
+        ok = false;
+    return ok;
+    }
+
+#if defined __GLIBC__
+static ssize_t compressorWrite(void * cookie,const char * buf,size_t size)
+#else
+static int compressorWrite(void * cookie,const char * buf,int size)
+#endif
+    {
+    ((compressor *)cookie)->put(buf,size);
+    return size;
+    }
+
+static int compressorClose(void * cookie)
+    {
+    compressor * C = (compressor *)cookie;
+    bool ok = C->close();
+    delete C;
+    return ok ? 0 : EOF;
+    }
+
+#endif
+
+FILE * compressingStream(FILE * fp,compression method)
+    {
+    if(method == noCompression || !fp)
+        return fp;
+#if HAVE_ZLIB || HAVE_ZSTD
+    compressor * C = new compressor(fp,method);
+#if defined __GLIBC__
+    cookie_io_functions_t functions = {NULL,compressorWrite,NULL,compressorClose};
+    FILE * stream = fopencookie(C,"w",functions);
+#else // BSD and macOS
+    FILE * stream = funopen(C,NULL,compressorWrite,NULL,compressorClose);
+#endif
+    if(!stream)
+        compressorClose(C);
+    else
+        setvbuf(stream,NULL,_IOFBF,1 << 16);
+    return stream;
+#else
+    if(fp != stdout)
+        fclose(fp);
+    return NULL;
+#endif
+    }
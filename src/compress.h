@@ -0,0 +1,48 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdio.h>
+
+/* Compressed output. gzip needs zlib (HAVE_ZLIB), zstd needs libzstd
+(HAVE_ZSTD), see the Makefile. */
+enum compression {noCompression,gzipCompression,zstdCompression};
+
+/* "gzip" or "zstd". False if name is neither or if that compression is not
+built in. */
+bool parseCompression(const char * name,compression & method);
+const char * compressionSuffix(compression method); // "", ".gz" or ".zst"
+
+#define COMPRESSIONCHUNK (1 << 20) // bytes handed to the compressing thread at a time
+#define COMPRESSIONQUEUE 4 // chunks that may wait for it
+
+/* Returns a stream that compresses what is written to it and writes the
+result to fp. The compression runs on its own thread, so that writing to the
+stream only waits when COMPRESSIONQUEUE chunks are waiting. Closing the stream
+finishes the compressed data and closes fp, or, if fp is stdout, flushes it.
+fclose fails if anything could not be written. With noCompression, fp itself
+is returned. Returns NULL, having closed fp as above, if there is no stream. */
+FILE * compressingStream(FILE * fp,compression method);
+
+#endif
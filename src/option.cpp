@@ -35,7 +35,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //        printf("usage: makeaffixrules -w <word list> -c <cutoff> -o <flexrules> -e <extra> -n <columns> -f <compfunc> [<word list> [<cutoff> [<flexrules> [<extra> [<columns> [<compfunc>]]]]]]\n");
 
 bool VERBOSE = false;
-static char opts[] = "?h@:w:o:p:l" /* GNU: */ "WR";
+static char opts[] = "?h@:w:o:p:f:k:lb:s:t:c:i:r:z:g:" /* GNU: */ "WR";
 static char *** Ppoptions = NULL;
 static char ** Poptions = NULL;
 static int optionSets = 0;
@@ -52,6 +52,16 @@ optionStruct::optionStruct()
     w = NULL;
     o = NULL;
     p = NULL;
+    f = NULL;
+    k = NULL;
+    b = NULL;
+    s = NULL;
+    t = NULL;
+    c = NULL;
+    i = NULL;
+    r = NULL;
+    z = NULL;
+    g = NULL;
     letters = false;
     }
 
@@ -65,6 +75,16 @@ optionStruct::~optionStruct()
     delete [] w;
     delete [] o;
     delete [] p;
+    delete [] f;
+    delete [] k;
+    delete [] b;
+    delete [] s;
+    delete [] t;
+    delete [] c;
+    delete [] i;
+    delete [] r;
+    delete [] z;
+    delete [] g;
     }
 
 OptReturnTp optionStruct::doSwitch(int optchar,char * locoptarg,char * progname)
@@ -83,21 +103,94 @@ OptReturnTp optionStruct::doSwitch(int optchar,char * locoptarg,char * progname)
         case 'p':
             p = dupl(locoptarg);
             break;
+        case 'f':
+            f = dupl(locoptarg);
+            break;
+        case 'k':
+            k = dupl(locoptarg);
+            break;
         case 'l':
             letters = true;
             break;
+        case 'b':
+            b = dupl(locoptarg);
+            break;
+        case 's':
+            s = dupl(locoptarg);
+            break;
+        case 't':
+            t = dupl(locoptarg);
+            break;
+        case 'c':
+            c = dupl(locoptarg);
+            break;
+        case 'i':
+            i = dupl(locoptarg);
+            break;
+        case 'r':
+            r = dupl(locoptarg);
+            break;
+        case 'z':
+            z = dupl(locoptarg);
+            break;
+        case 'g':
+            g = dupl(locoptarg);
+            break;
         case 'h':
         case '?':
             printf("usage:\n"
-                "repver [-@ <option file>] [-w <weight>] [-o <output>] [-p <passes>] [-l] file1 file2 file3 ..."
+                "repver [-@ <option file>] [-w <weight>] [-o <output>] [-p <passes>] [-f <fuzzy match level>] [-k <top>] [-l] [-t <format>] [-c <marked>] [-i <index>] [-z <compression>] [-g <pages>] file1 file2 file3 ...\n"
+                "repver [-z <compression>] -r <index> [file1 file2 ...]\n"
+                "repver [-@ <option file>] [-w <weight>] [-o <output>] [-p <passes>] [-f <fuzzy match level>] [-k <top>] -b <manifest>\n"
+                "repver [-@ <option file>] [-w <weight>] [-p <passes>] [-f <fuzzy match level>] [-k <top>] -s <socket>"
                 "\n");
             printf("-@: Options are read from file with lines formatted as: -<option letter> <value>\n"
                    "    A semicolon comments out the rest of the line.\n"
                 );
-            printf("-w: weight function 1-10\n");
+            printf("-w: weight function 1-10, a comma separated list of those, or all.\n"
+                   "    With more than one weight function, the phrases are ranked once for\n"
+                   "    each. The output has a phrase table per weight function. The marked\n"
+                   "    texts show the first.\n"
+                );
             printf("-o: (output) list of found prases. Default is standard output\n");
             printf("-p: passes: 1 or 2 (default). (2 to eliminate overlap).\n");
+            printf("-f: fuzzy match level: 100 (sentence), 95, 85, 75, 50 or 0 (no limit, default),\n"
+                   "    or a comma separated list of those. The phrases are ranked once for each.\n"
+                );
+            printf("-k: only find the <top> highest ranked repeated phrases. Faster, but the\n"
+                   "    repetitiveness is then a lower bound.\n"
+                );
             printf("-l: morpheme analysis on all types in input.\n");
+            printf("-b: batch: analyse each file listed in <manifest>, one per line, on its\n"
+                   "    own and write a line with its scores and top phrases to the output.\n"
+                   "    <manifest> - is standard input. See batch.h for the format.\n"
+                );
+            printf("-s: server: answer analysis requests on the Unix domain socket <socket>,\n"
+                   "    or on standard input and output if <socket> is -. The other options\n"
+                   "    are the defaults for the requests. See server.h for the protocol.\n"
+                );
+            printf("-t: phrase table: write the repeated phrases to the output as tsv, jsonl\n"
+                   "    or binary instead of as HTML. Append ,ids to write type numbers\n"
+                   "    instead of words. See repetitions.h for the formats.\n"
+                );
+            printf("-c: combined: write all marked texts to the one HTML file <marked>\n"
+                   "    instead of each to <file>.html.\n"
+                );
+            printf("-i: span index: instead of the marked texts, write where their spans are\n"
+                   "    to <index>, as text or, with binary,<index>, binary. See\n"
+                   "    WriteSpanIndex in repetitions.h for the formats.\n"
+                );
+            printf("-r: render: write the marked texts of the files, or of all files, in\n"
+                   "    the span index <index> to <file>.html.\n"
+                );
+            printf("-z: compression: gzip or zstd. The output and the marked texts are\n"
+                   "    compressed on their own threads. The marked texts are written to\n"
+                   "    <file>.html.gz or <file>.html.zst.\n"
+                );
+            printf("-g: pages: write the phrase tables to pages <pages>-<ranking>-<page>.html\n"
+                   "    of 1000 rows, or of <rows> rows with -g <pages>,<rows>, as soon as\n"
+                   "    their rows are final. The output links to the pages.\n"
+                );
             return Leave;
 // GNU >>
         case 'R':
@@ -30,6 +30,16 @@ struct optionStruct
     const char * w; // weight
     const char * o; // output
     const char * p; // passes
+    const char * f; // fuzzy match levels
+    const char * k; // top-K
+    const char * b; // batch: manifest with a file per line
+    const char * s; // server: socket path, or - for standard input and output
+    const char * i; // span index instead of marked texts, optionally preceded by binary,
+    const char * r; // render: span index to render marked texts from
+    const char * g; // pages: prefix of the phrase table pages, optionally followed by ,rows
+    const char * z; // compression: gzip or zstd
+    const char * c; // combined: one file for all marked texts
+    const char * t; // phrase table format: tsv, jsonl or binary, optionally followed by ,ids
     bool letters; // morpheme analysis
     optionStruct();
     ~optionStruct();
@@ -0,0 +1,215 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "output.h"
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+
+void outputBuffer::flush()
+    {
+    if(used > 0)
+        fwrite(buf,1,used,fp);
+    used = 0;
+    }
+
+gatherBuffer::gatherBuffer(FILE * fp):fp(fp),good(true),count(0),used(0)
+    {
+    fflush(fp);
+    fd = fileno(fp);
+    }
+
+void gatherBuffer::flush()
+    {
+    struct iovec * v = vec;
+    int n = count;
+    if(fd < 0)
+        {
+        for(int i = 0;i < n;++i)
+            if(fwrite(v[i].iov_base,1,v[i].iov_len,fp) != v[i].iov_len)
+                good = false;
+        }
+    else
+        {
+        while(n > 0 && good)
+            {
+            ssize_t written = writev(fd,v,n);
+            if(written < 0)
+                {
+                if(errno != EINTR)
+                    good = false;
+                continue;
+                }
+            while(n > 0 && (size_t)written >= v->iov_len)
+                {
+                written -= v->iov_len;
+                ++v;
+                --n;
+                }
+            if(n > 0)
+                { // partly written
+                v->iov_base = (char *)v->iov_base + written;
+                v->iov_len -= written;
+                }
+            }
+        }
+    count = 0;
+    used = 0;
+    }
+
+void outputBuffer::putUnsigned(unsigned long long v)
+    {
+    char digits[20];
+    char * p = digits + sizeof(digits);
+    do
+        {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+        }
+    while(v);
+    put(p,digits + sizeof(digits) - p);
+    }
+
+void outputBuffer::putFixed(double x)
+    {
+    if(!(x > -1e12 && x < 1e12))
+        { // large, infinite or not a number
+        char s[400];
+        int n = snprintf(s,sizeof(s),"%.6f",x);
+        put(s,n);
+        return;
+        }
+    if(signbit(x))
+        {
+        put('-');
+        x = -x;
+        }
+    unsigned long long v = (unsigned long long)llround(x * 1e6);
+    putUnsigned(v / 1000000);
+    char fraction[7];
+    unsigned long f = (unsigned long)(v % 1000000);
+    fraction[0] = '.';
+    for(int i = 6;i > 0;--i)
+        {
+        fraction[i] = (char)('0' + f % 10);
+        f /= 10;
+        }
+    put(fraction,sizeof(fraction));
+    }
+
+/* Length of the well-formed UTF-8 sequence at s, or 0 if there is none. */
+static int UTF8SequenceLength(const unsigned char * s)
+    {
+    int n;
+    unsigned char low = 0x80,high = 0xBF; // range of the second byte
+    if(s[0] >= 0xC2 && s[0] <= 0xDF)
+        n = 2;
+    else if(s[0] >= 0xE0 && s[0] <= 0xEF)
+        {
+        n = 3;
+        if(s[0] == 0xE0)
+            low = 0xA0; // overlong
+        else if(s[0] == 0xED)
+            high = 0x9F; // surrogate
+        }
+    else if(s[0] >= 0xF0 && s[0] <= 0xF4)
+        {
+        n = 4;
+        if(s[0] == 0xF0)
+            low = 0x90; // overlong
+        else if(s[0] == 0xF4)
+            high = 0x8F; // beyond U+10FFFF
+        }
+    else
+        return 0;
+    if(s[1] < low || s[1] > high)
+        return 0;
+    for(int i = 2;i < n;++i)
+        if((s[i] & 0xC0) != 0x80)
+            return 0;
+    return n;
+    }
+
+void outputBuffer::putJSONString(const char * s,bool UTF8)
+    {
+    static const char hex[] = "0123456789abcdef";
+    put('"');
+    while(*s)
+        {
+        unsigned char c = (unsigned char)*s;
+        if(c == '"' || c == '\\')
+            {
+            put('\\');
+            put((char)c);
+            ++s;
+            }
+        else if(c < 0x20 || (c >= 0x80 && !UTF8))
+            { // ISO-8859-1 bytes are the code points U+0080..U+00FF
+            char escape[6] = {'\\','u','0','0',hex[c >> 4],hex[c & 15]};
+            put(escape,sizeof(escape));
+            ++s;
+            }
+        else if(c >= 0x80)
+            {
+            int n = UTF8SequenceLength((const unsigned char *)s);
+            if(n)
+                {
+                put(s,n);
+                s += n;
+                }
+            else
+                { // not UTF-8 after all
+                put("\\ufffd",6);
+                ++s;
+                }
+            }
+        else
+            {
+            put((char)c);
+            ++s;
+            }
+        }
+    put('"');
+    }
+
+void outputBuffer::put32(uint32_t v)
+    {
+    char b[4];
+    for(int i = 0;i < 4;++i)
+        b[i] = (char)(v >> (8 * i));
+    put(b,sizeof(b));
+    }
+
+void outputBuffer::put64(uint64_t v)
+    {
+    char b[8];
+    for(int i = 0;i < 8;++i)
+        b[i] = (char)(v >> (8 * i));
+    put(b,sizeof(b));
+    }
+
+void outputBuffer::putDouble(double x)
+    {
+    uint64_t v;
+    memcpy(&v,&x,sizeof(v));
+    put64(v);
+    }
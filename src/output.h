@@ -0,0 +1,142 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/* Collects output in a buffer and hands it to fwrite in large pieces. Numbers
+are formatted without going through stdio. */
+class outputBuffer
+    {
+    FILE * fp;
+    size_t used;
+    char buf[1 << 16];
+public:
+    outputBuffer(FILE * fp):fp(fp),used(0)
+        {
+        }
+    outputBuffer(const outputBuffer &) = delete;
+    outputBuffer & operator=(const outputBuffer &) = delete;
+    ~outputBuffer()
+        {
+        flush();
+        }
+    void flush();
+    void put(const char * s,size_t n)
+        {
+        if(used + n > sizeof(buf))
+            {
+            flush();
+            if(n > sizeof(buf))
+                {
+                fwrite(s,1,n,fp);
+                return;
+                }
+            }
+        memcpy(buf + used,s,n);
+        used += n;
+        }
+    void put(const char * s)
+        {
+        put(s,strlen(s));
+        }
+    void put(char c)
+        {
+        if(used == sizeof(buf))
+            flush();
+        buf[used++] = c;
+        }
+    void putUnsigned(unsigned long long v);
+    void putFixed(double x); // like "%.6f"
+    void putJSONString(const char * s,bool UTF8); // quoted and escaped, s is ISO-8859-1 unless UTF8
+    // little endian, whatever the machine
+    void put32(uint32_t v);
+    void put64(uint64_t v);
+    void putDouble(double x); // IEEE 754 double
+    };
+
+#define GATHERVECTORS 1024 // pieces per writev
+#define GATHERCOPY 256 // shorter pieces are copied
+
+/* Collects pieces of output and writes them with writev to the file descriptor
+of a stream. Pieces of GATHERCOPY bytes or more are not copied and must stay
+put until they are flushed, shorter ones are copied to a buffer. Streams
+without a file descriptor, such as memory streams, get the pieces by fwrite. */
+class gatherBuffer
+    {
+    FILE * fp;
+    int fd;
+    bool good;
+    int count;
+    size_t used;
+    struct iovec vec[GATHERVECTORS];
+    char buf[1 << 16];
+public:
+    gatherBuffer(FILE * fp); // flushes fp
+    gatherBuffer(const gatherBuffer &) = delete;
+    gatherBuffer & operator=(const gatherBuffer &) = delete;
+    ~gatherBuffer()
+        {
+        flush();
+        }
+    void flush();
+    bool ok() const // false once a write has failed
+        {
+        return good;
+        }
+    void put(const char * s,size_t n)
+        {
+        if(n == 0)
+            return;
+        if(n >= GATHERCOPY)
+            {
+            if(count == GATHERVECTORS)
+                flush();
+            vec[count].iov_base = (void *)s;
+            vec[count++].iov_len = n;
+            return;
+            }
+        if(used + n > sizeof(buf) || count == GATHERVECTORS)
+            flush();
+        char * dest = buf + used;
+        memcpy(dest,s,n);
+        used += n;
+        if(count > 0 && (char *)vec[count - 1].iov_base + vec[count - 1].iov_len == dest)
+            vec[count - 1].iov_len += n;
+        else
+            {
+            vec[count].iov_base = dest;
+            vec[count++].iov_len = n;
+            }
+        }
+    void put(const char * s)
+        {
+        put(s,strlen(s));
+        }
+    };
+
+#endif
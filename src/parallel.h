@@ -0,0 +1,69 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+
+int numberOfThreads();
+void setNumberOfThreads(int n); // 0: as many as the hardware supports
+
+extern thread_local bool insideParallelFor;
+
+/* Calls f(first,last) for consecutive slices [first,last) of [0,n), each slice
+on its own thread. No slice is smaller than grain, so small ranges are handled
+by the calling thread alone. A parallelFor inside a slice of another one runs
+on the thread of that slice. Returns when all slices are done. */
+template <class F> void parallelFor(unsigned long n,unsigned long grain,F f)
+    {
+    unsigned long nthreads = numberOfThreads();
+    if(grain == 0)
+        grain = 1;
+    if(nthreads > n / grain)
+        nthreads = n / grain;
+    if(nthreads <= 1 || insideParallelFor)
+        {
+        f(0UL,n);
+        return;
+        }
+    unsigned long slice = (n + nthreads - 1) / nthreads;
+    std::thread * workers = new std::thread[nthreads - 1];
+    for(unsigned long t = 1;t < nthreads;++t)
+        {
+        unsigned long first = t * slice;
+        unsigned long last = first + slice < n ? first + slice : n;
+        workers[t - 1] = std::thread([f,first,last]()
+            {
+            insideParallelFor = true;
+            f(first,last);
+            });
+        }
+    insideParallelFor = true;
+    f(0UL,slice);
+    insideParallelFor = false;
+    for(unsigned long t = 1;t < nthreads;++t)
+        workers[t - 1].join();
+    delete [] workers;
+    }
+
+#endif
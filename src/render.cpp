@@ -0,0 +1,333 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "render.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+void writeHTMLHeader(FILE * fpo,bool UTF8)
+    {
+    fprintf(fpo,
+        "<?xml version=\"1.0\" encoding=\"%s\" ?>\n"
+        "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Strict//EN\" "
+        "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-strict.dtd\">\n"
+        "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+        "<head>\n"
+        "<title></title>\n"
+        "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=%s\"/>\n"
+        "<style type=\"text/css\">"
+        "span { background-color: Silver; } </style>"
+        "</head>\n"
+        "<body>\n",
+        UTF8 ? "UTF-8" : "ISO-8859-1",
+        UTF8 ? "UTF-8" : "ISO-8859-1"
+        );
+    }
+
+void writeDoubleslashed(FILE * fpo,const char * s)
+    {
+    for(;*s;++s)
+        {
+        if(*s == '\\')
+            fputc('\\',fpo);
+        fputc(*s,fpo);
+        }
+    }
+
+void writeTextHTML(gatherBuffer & out,const char * text,size_t & inpos,size_t end)
+    {
+    while(inpos < end)
+        {
+        const char * start = text + inpos;
+        const char * newline = (const char *)memchr(start,'\n',end - inpos);
+        if(!newline)
+            {
+            out.put(start,end - inpos);
+            inpos = end;
+            }
+        else
+            {
+            out.put(start,newline - start);
+            out.put("<br />\n",7);
+            inpos = newline + 1 - text;
+            }
+        }
+    }
+
+typedef struct span
+    {
+    size_t start;
+    size_t end;
+    bool joined; // follows the previous span without a word in between
+    } span;
+
+typedef struct indexedFile
+    {
+    std::string name;
+    size_t end; // of the last token
+    std::vector<span> spans;
+    } indexedFile;
+
+/* What render needs from a span index. */
+class spanIndex
+    {
+    std::unordered_map<std::string,size_t> numbers;
+    bool addFile(const std::string & name,size_t end);
+    bool readTSV(char * data,size_t length);
+    bool readBinary(const unsigned char * data,size_t length);
+public:
+    bool UTF8;
+    std::vector<indexedFile> files;
+    spanIndex():UTF8(true)
+        {
+        }
+    bool read(const char * name);
+    indexedFile * find(const char * name)
+        {
+        auto f = numbers.find(name);
+        return f == numbers.end() ? NULL : &files[f->second];
+        }
+    };
+
+bool spanIndex::addFile(const std::string & name,size_t end)
+    {
+    if(!numbers.emplace(name,files.size()).second)
+        return false;
+    files.push_back(indexedFile());
+    files.back().name = name;
+    files.back().end = end;
+    return true;
+    }
+
+/* See WriteSpanIndex. The names must not contain tabs or line breaks. */
+bool spanIndex::readTSV(char * data,size_t length)
+    {
+    char * end = data + length;
+    indexedFile * current = NULL;
+    for(char * line = data;line < end;)
+        {
+        char * eol = (char *)memchr(line,'\n',end - line);
+        if(!eol)
+            eol = end;
+        *eol = '\0';
+        char * next = eol + 1;
+        if(!strncmp(line,"# encoding\t",11))
+            UTF8 = !strcmp(line + 11,"UTF-8");
+        else if(!strncmp(line,"# file\t",7))
+            {
+            char * name;
+            size_t fileEnd = strtoull(line + 7,&name,10);
+            if(*name != '\t' || !addFile(name + 1,fileEnd))
+                return false;
+            }
+        else if(*line && *line != '#' && strncmp(line,"file\t",5))
+            {
+            char * tab = strchr(line,'\t');
+            if(!tab)
+                return false;
+            *tab = '\0';
+            if(!current || current->name != line)
+                {
+                current = find(line);
+                if(!current)
+                    return false;
+                }
+            span s;
+            char * p;
+            s.start = strtoull(tab + 1,&p,10);
+            s.end = strtoull(p,&p,10);
+            strtoul(p,&p,10); // the rank
+            s.joined = strtoul(p,&p,10) != 0;
+            current->spans.push_back(s);
+            }
+        line = next;
+        }
+    return true;
+    }
+
+static uint64_t get(const unsigned char *& p,int bytes)
+    {
+    uint64_t v = 0;
+    for(int i = 0;i < bytes;++i)
+        v |= (uint64_t)*p++ << (8 * i);
+    return v;
+    }
+
+/* See WriteSpanIndex. */
+bool spanIndex::readBinary(const unsigned char * data,size_t length)
+    {
+    const unsigned char * end = data + length;
+    const unsigned char * p = data + 4;
+    if(end - p < 8)
+        return false;
+    UTF8 = get(p,4) != 0;
+    uint32_t nfiles = (uint32_t)get(p,4);
+    for(uint32_t f = 0;f < nfiles;++f)
+        {
+        if(end - p < 12)
+            return false;
+        size_t fileEnd = get(p,8);
+        size_t len = get(p,4);
+        if((size_t)(end - p) < len || !addFile(std::string((const char *)p,len),fileEnd))
+            return false;
+        p += len;
+        }
+    while(end - p >= 28)
+        {
+        uint32_t file = (uint32_t)get(p,4);
+        span s;
+        s.start = get(p,8);
+        s.end = get(p,8);
+        get(p,4); // the rank
+        s.joined = get(p,4) & 1;
+        if(file >= nfiles)
+            return false;
+        files[file].spans.push_back(s);
+        }
+    return p == end;
+    }
+
+bool spanIndex::read(const char * name)
+    {
+    FILE * fp = fopen(name,"rb");
+    if(!fp)
+        return false;
+    size_t capacity = 65536;
+    size_t length = 0;
+    char * data = (char *)malloc(capacity);
+    size_t n;
+    while(data && (n = fread(data + length,1,capacity - length,fp)) > 0)
+        {
+        length += n;
+        if(length == capacity)
+            data = (char *)realloc(data,capacity *= 2);
+        }
+    fclose(fp);
+    if(!data)
+        return false;
+    bool ok = length >= 4 && !memcmp(data,"RPS1",4)
+            ? readBinary((const unsigned char *)data,length)
+            : readTSV(data,length);
+    free(data);
+    return ok;
+    }
+
+/* Writes F.name.html as WriteTextWithMarkings would have. */
+static bool renderFile(const indexedFile & F,bool UTF8,compression method)
+    {
+    FILE * fp = fopen(F.name.c_str(),"rb");
+    if(!fp)
+        {
+        fprintf(stderr,"Cannot open %s for reading\n",F.name.c_str());
+        return false;
+        }
+    struct stat st;
+    const char * text = NULL;
+    size_t length = 0;
+    if(fstat(fileno(fp),&st) == 0 && st.st_size > 0)
+        {
+        void * address = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fileno(fp),0);
+        if(address != MAP_FAILED)
+            {
+            text = (const char *)address;
+            length = st.st_size;
+            }
+        }
+    fclose(fp);
+    bool rendered = false;
+    if(F.end > length)
+        fprintf(stderr,"%s is shorter than the index says\n",F.name.c_str());
+    else
+        {
+        std::string markedfile = F.name + ".html" + compressionSuffix(method);
+        FILE * fpo = compressingStream(fopen(markedfile.c_str(),"wb"),method);
+        if(!fpo)
+            fprintf(stderr,"Cannot open %s for writing\n",markedfile.c_str());
+        else
+            {
+            writeHTMLHeader(fpo,UTF8);
+            fprintf(fpo,"<h1>");
+            writeDoubleslashed(fpo,F.name.c_str());
+            fprintf(fpo,"</h1><p>\n");
+            gatherBuffer out(fpo);
+            size_t inpos = 0;
+            for(const span & s : F.spans)
+                {
+                if(s.end > F.end)
+                    break;
+                if(s.joined)
+                    out.put(" |",2);
+                writeTextHTML(out,text,inpos,s.start);
+                out.put("<span>",6);
+                writeTextHTML(out,text,inpos,s.end);
+                out.put("</span>",7);
+                }
+            writeTextHTML(out,text,inpos,F.end);
+            out.put("</p>",4);
+            out.flush();
+            rendered = out.ok();
+            fprintf(fpo,"%s\n",
+                "</body>\n"
+                "</html>\n");
+            if(fclose(fpo) != 0)
+                rendered = false;
+            }
+        }
+    if(length > 0)
+        munmap((void *)text,length);
+    return rendered;
+    }
+
+int render(const char * index,char ** names,compression method)
+    {
+    spanIndex S;
+    if(!S.read(index))
+        {
+        fprintf(stderr,"Cannot read span index %s\n",index);
+        return 1;
+        }
+    int result = 0;
+    if(!*names)
+        {
+        for(const indexedFile & F : S.files)
+            if(!renderFile(F,S.UTF8,method))
+                result = 1;
+        }
+    for(;*names;++names)
+        {
+        const indexedFile * F = S.find(*names);
+        if(!F)
+            {
+            fprintf(stderr,"%s is not in span index %s\n",*names,index);
+            result = 1;
+            }
+        else if(!renderFile(*F,S.UTF8,method))
+            result = 1;
+        }
+    return result;
+    }
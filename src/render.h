@@ -0,0 +1,47 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+#include "output.h"
+#include "compress.h"
+
+/* The pieces of a marked text in HTML, and a renderer that writes marked texts
+from a span index instead of from an analysis. */
+
+void writeHTMLHeader(FILE * fpo,bool UTF8);
+void writeDoubleslashed(FILE * fpo,const char * s); // s with each backslash doubled
+/* Copies text[inpos,end) to out, with line breaks as <br />. The stretches
+between line breaks are passed on without copying. */
+void writeTextHTML(gatherBuffer & out,const char * text,size_t & inpos,size_t end);
+
+/* Writes the marked text of each of the files in names, or of all files in the
+index if names is empty, to <file>.html, compressed with method (see
+compressionSuffix). The spans are read from index, which
+WriteSpanIndex (see repetitions.h) wrote, and the texts from the files, which
+must not have changed since. The output is the same as that of
+WriteTextWithMarkings(). Returns the exit code. */
+int render(const char * index,char ** names,compression method);
+
+#endif
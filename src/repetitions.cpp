@@ -42,36 +42,35 @@ BUT, A B A one time -> A B A zero times, which gives B A three occurrences!
 #include <math.h>
 #include <assert.h>
 #include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 //#if defined _CONSOLE
 #include "argopt.h"
 #include "option.h"
 //#endif
 #include "repetitions.h"
 #include "utf8func.h"
+#include "parallel.h"
+#include "arena.h"
+#include "server.h"
+#include "batch.h"
+#include "output.h"
+#include "render.h"
+#include "compress.h"
 #ifdef __BORLANDC__
 #include "addtochart.h"
 #endif
-static unsigned long lowestfreq = ULONG_MAX,highestfreq = 0L;
-static unsigned long tokens = 0L,gtokens;
-static unsigned long types = 0L;
-static unsigned long lowtype = 0L,hightype = 0L;
-static unsigned long realUnmatched = 0L;
-static size_t fiducialTextLength = 0L;
-static size_t reducedTextLength = 0L;
-static unsigned long numberOfPhrases = 0;
-static unsigned long numberOfSentenceSeparators = 0;
-static double repetitiveness = 1.0;
-static double averageTypeFrequency = 0.0;
-// phrase length = b + m * log(phrase #)
-static double m; // gradient
-static double b; // offset
-static char * textBuffer = NULL;
-bool versioncomparison = false;
-bool recursive = false;
-bool unlimited = true;
-static int npasses = 1;
-int maxlimit = -1;
-int minlimit = 2;
 static double logfac[1000];
 
 class leastSquareFitter
@@ -120,29 +119,185 @@ typedef struct word
     type * tp;
     long fileStartPos;
     long fileEndPos;
-    char marked;
     } word;
 
-static word * lastword = NULL;
-static word * afterlastword = NULL;
-
 typedef struct filedata
     {
     filedata()
         {
         filename = NULL;
-        }
-    ~filedata()
-        {
-        delete filename;
+        text = NULL;
+        length = 0;
         }
     char * filename;
-    unsigned long realUnmatched;
+    const char * text; // the caller's buffer or the file read into the arena
+    size_t length;
     unsigned long numberOfSentenceSeparators;
     word * boundary;
     } filedata;
 
-static filedata * filedatalist = NULL;
+class phrase;
+struct ranking;
+class pageWriter;
+struct phrasekey;
+struct typestat;
+struct indexentry;
+
+/* What selectFuzzynessBoundary sets: how phrases are found and which of their
+occurrences count. */
+typedef struct fuzzyness
+    {
+    int boundary; // 100: sentence, 0: no limit, otherwise percentage
+    void (*FindReps)(word * startofsentence,word * endofsentence,bool startOK,bool endOK);
+    bool (*goodSize)
+        (
+        word * phraseStart,
+        size_t length,
+        word * firstOfText,
+        word * firstOfNextText,
+        double MaxUncovered
+        );
+    double MaxUncovered;
+    } fuzzyness;
+
+/* The phrases found by one of the FindReps functions. */
+typedef struct discovery
+    {
+    void (*FindReps)(word * startofsentence,word * endofsentence,bool startOK,bool endOK);
+    phrase * records; // contiguous
+    unsigned long numberOfPhrases;
+    } discovery;
+
+#define NUMBEROFDISCOVERIES 2 // FindRepsWithinSentence and FindRepsAsSentence
+#define MAXFUZZYLEVELS 10
+#define NUMBEROFWEIGHTS 10 // entries in weightrecs
+
+enum Inside {nowhere,instring,indelimiter,inignored,inatomic,insentencedelimiter};
+
+/* What the set*, choose* and select* functions and fill_character_properties
+set. A new analysis starts with a copy of the settings of the current one. */
+struct analysisSettings
+    {
+    bool versioncomparison;
+    int npasses;
+    unsigned long topK; // 0: rank all phrases
+    int maxlimit;
+    int minlimit;
+    bool case_sensitive;
+    const char * markedOutput; // NULL: a file per text, see setMarkedOutput
+    bool writeMarkedTexts;
+    compression markedCompression;
+    const char * pagePrefix; // NULL: no pages, see setPhrasePages
+    const char * pageIndex; // the file that links to the pages, or NULL
+    unsigned long rowsPerPage;
+    charprop character[256];
+    int replacement_for_string_constituent[256];
+    fuzzyness Fuzzyness;
+    // More than one level: rankings for each, otherwise for Fuzzyness.
+    fuzzyness requestedLevels[MAXFUZZYLEVELS];
+    int numberOfRequestedLevels;
+    void (*setWeight)(ranking * R,phrasekey * keys);
+    // More than one weight: a ranking for each, otherwise one ranking for setWeight.
+    void (*requestedWeights[NUMBEROFWEIGHTS])(ranking * R,phrasekey * keys);
+    int numberOfRequestedWeights;
+    };
+
+/* All that one analysis reads, finds and ranks. Analyses in different threads
+are independent. The functions in this file work on the analysis that is
+current in the calling thread, see UseAnalysis(). */
+class analysis : public analysisSettings
+    {
+public:
+    analysis();
+    ~analysis();
+    analysis(const analysis &) = delete;
+    analysis & operator=(const analysis &) = delete;
+    /* Everything that lives as long as an analysis, from the tokens to the
+    rankings, is allocated in this arena and released in one go by
+    EndAnalysis(). */
+    arena memory;
+    unsigned long lowestfreq,highestfreq;
+    unsigned long tokens,gtokens;
+    unsigned long types;
+    unsigned long lowtype,hightype;
+    unsigned long numberOfSentenceSeparators;
+    double averageTypeFrequency;
+    double logTokens;
+    bool UTF8; // false once a type turns out not to be UTF-8
+    bool morphemes; // the types are morphemes, phrases are written without spaces
+    struct mappedFile
+        {
+        void * address;
+        size_t length;
+        mappedFile * next;
+        };
+    mappedFile * mappedFiles; // the files readFile mapped, unmapped by EndAnalysis
+    void unmapFiles();
+    char * textBuffer; // token text, only while reading
+    char * vocabulary; // all type names, each once
+    word * words1;
+    word * lastword;
+    word * afterlastword;
+    filedata * filedatalist;
+    int numberOfFiles;
+    type * typeArray;
+    unsigned long * nameOrder; // type numbers in alphabetical order
+    typestat * typeStats;
+    unsigned char * postingData; // the posting lists of all types
+    uint32_t * tokenIds;
+    discovery discoveries[NUMBEROFDISCOVERIES];
+    int numberOfDiscoveries;
+    ranking * rankings;
+    int numberOfRankings;
+    int numberOfRankedLevels; // rankings are grouped by fuzzy match level
+    int shownRanking; // the ranking that is reported and written
+    // reading
+    long inpos;
+    unsigned long numberOfBytes;
+    char * ptextBuffer;
+    indexentry * theBigIndex;
+    indexentry ** pindex;
+    Inside inside;
+    };
+
+// The current analysis is read in the innermost loops, so it should not cost a
+// call to look it up.
+#if defined __GNUC__
+#define INITIALEXEC __attribute__((tls_model("initial-exec")))
+#else
+#define INITIALEXEC
+#endif
+
+static analysis defaultAnalysis;
+static thread_local analysis * context INITIALEXEC = &defaultAnalysis;
+
+/* Makes an analysis current in this thread for as long as it exists. */
+class analysisScope
+    {
+    analysis * previous;
+public:
+    analysisScope(analysis * A):previous(context)
+        {
+        context = A ? A : &defaultAnalysis;
+        }
+    ~analysisScope()
+        {
+        context = previous;
+        }
+    };
+
+/* parallelFor, with the slices working on the analysis of the calling
+thread. */
+template <class F> static void parallelForAnalysis(unsigned long n,unsigned long grain,F f)
+    {
+    analysis * A = context;
+    parallelFor(n,grain,[A,f](unsigned long first,unsigned long last)
+        {
+        analysisScope scope(A);
+        f(first,last);
+        });
+    }
+
 
 class phrase
     {
@@ -184,38 +339,51 @@ public:
             weight(1.0)
         {
         }
-    ~phrase()
+    phrase():wording(NULL),
+            next(NULL),
+            offset(0),
+            length(0),
+            count(0L),
+            realCount(0L),
+            weight(1.0)
         {
-        wording = NULL;
-        delete next;
-        next = NULL;
         }
     void add(word * wording
             ,ptrdiff_t offset
             ,size_t length
             )
         {
-        if(this->offset == offset
-        && this->length == length)
+        phrase * last = this;
+        for ( phrase * Phrase = this
+            ; Phrase
+            ; Phrase = Phrase->next
+            )
             {
-            size_t i;
-            for ( i = 0
-                ; i < length && this->wording[i].tp == wording[i].tp
-                ; ++i
-                )
-                ;
-            if(i == length)
-                return; // phrase already found
+            if(Phrase->offset == offset
+            && Phrase->length == length)
+                {
+                size_t i;
+                for ( i = 0
+                    ; i < length && Phrase->wording[i].tp == wording[i].tp
+                    ; ++i
+                    )
+                    ;
+                if(i == length)
+                    return; // phrase already found
+                }
+            last = Phrase;
             }
-        if(next)
-            next->add(wording,offset,length);
-        else
-            next = new phrase(wording,offset,length);
+        last->next = new(context->memory.allocate(sizeof(phrase),alignof(phrase))) phrase(wording,offset,length);
         }
     phrase * Next() const
         {
         return next;
         }
+    void copyTo(phrase * record) const
+        {
+        *record = *this;
+        record->next = NULL; // the chain stays with the original
+        }
     word * Wording() const
         {
         return wording;
@@ -241,32 +409,14 @@ public:
         {
         return realCount;
         }
-    void setWeightAsFrequency()
+    void setRealCount(unsigned long realCount)
         {
-        weight = count;
-        if(next)
-            next->setWeightAsFrequency();
+        this->realCount = realCount;
         }
-    void setWeightAsLength()
+    void setWeight(double weight)
         {
-        weight = length;
-        if(next)
-            next->setWeightAsLength();
+        this->weight = weight;
         }
-    void setWeightAsFrequencyTimesLength()
-        {
-        weight = length * count;
-        if(next)
-            next->setWeightAsFrequencyTimesLength();
-        }
-    void setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
-    void setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency();
-    void setWeightAsFrequencyTimesLengthTimesAverageOfEntropy();
-    void setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength();
-//    void setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction();
-    void setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction();
-    void setWeight2005();
-    void setWeight2005b();
     void print(FILE * fp);
 //    bool printsimple(FILE * fp, unsigned long phraseno);
     bool printsimpleARG(bool morphemes,FILE * fp, unsigned long phraseno,bool b_phraseno,bool b_realCount,bool b_weight, bool b_getAccumulatedRepetitiveness,const char * A,const char * Z);
@@ -277,30 +427,169 @@ public:
         {
         return weight;
         }
-    unsigned long countPhrase(word * words, bool recount);
-    unsigned long countPhraseInText(/*word * words, */bool recount,
+    unsigned long countOccurrences(const fuzzyness * F);
+        // sets count
+    unsigned long countPhrase(ranking * R, bool recount);
+    unsigned long countPhraseInText(ranking * R, bool recount,
             word * textFirst, word * nextTextFirst);
         // changes 'f' to 'B', 't' and 'e'
-    void confirmPhraseInText(word * textFirst, word * nextTextFirst);
+    void confirmPhraseInText(ranking * R, word * textFirst, word * nextTextFirst);
+    void rankOccurrences(const char * marked,uint32_t * rankAt,uint32_t rank);
         // changes 'B' to 'b'
-    unsigned long uncountPhraseInText(/*word * words,*/
+    unsigned long uncountPhraseInText(ranking * R,
             word * textFirst, word * nextTextFirst);
         // changes 'B' 't' 'e' to 'f'
     };
 
-static type * typeArray = NULL;
+/* Types are numbered in order of descending frequency, so the types that the
+phrase loops visit most often are together at the start of typeArray and
+typeStats. Types with the same frequency are in alphabetical order. */
+
+/* Quantities that the weight functions need for every token of every phrase.
+Computed once per type by computeTypeStatistics() and stored contiguously,
+indexed by the position of the type in typeArray. */
+typedef struct typestat
+    {
+    double inverseFrequency;    // 1/f
+    double entropy;             // -p log p, p = 1/f
+    double ratio;               // averageTypeFrequency/f for words, else 1
+    double logFrequency;        // log f
+    double probability;         // f/tokens
+    } typestat;
+
+
+
+/* Posting lists. The positions of the tokens of a type are stored in words1
+order as zigzag coded differences, so the list may step back. The differences
+are packed in blocks of POSTINGBLOCK values, each block having two bits per
+value for the number of bytes (1-4) of the value, four values per control
+byte, followed by the values themselves (stream-vbyte). Whole control bytes
+are decoded with one byte shuffle where the CPU supports it. */
+#define POSTINGBLOCK 64
+#define POSTINGPADDING 16 // a decoder may read this far past the last value
+
+
+static unsigned char postingLength[256]; // data bytes per control byte
+
+static size_t encodePostings(const uint32_t * positions,unsigned long n,unsigned char * out)
+    // Writes the posting list to out, unless out is NULL. Returns its size.
+    {
+    size_t size = 0;
+    uint32_t previous = 0;
+    for(unsigned long first = 0;first < n;first += POSTINGBLOCK)
+        {
+        unsigned long m = n - first < POSTINGBLOCK ? n - first : POSTINGBLOCK;
+        unsigned char * control = out ? out + size : NULL;
+        if(control)
+            memset(control,0,(m + 3) / 4);
+        size += (m + 3) / 4;
+        for(unsigned long i = 0;i < m;++i)
+            {
+            uint32_t difference = positions[first + i] - previous;
+            uint32_t v = (difference << 1) ^ (0U - (difference >> 31));
+            unsigned int len = v < 0x100U ? 1 : v < 0x10000U ? 2 : v < 0x1000000U ? 3 : 4;
+            previous = positions[first + i];
+            if(out)
+                {
+                control[i >> 2] |= (unsigned char)((len - 1) << ((i & 3) << 1));
+                for(unsigned int k = 0;k < len;++k)
+                    out[size + k] = (unsigned char)(v >> (8 * k));
+                }
+            size += len;
+            }
+        }
+    return size;
+    }
+
+static const unsigned char * decodePostingsScalar(const unsigned char * in,unsigned int n,uint32_t & previous,uint32_t * out)
+    {
+    const unsigned char * data = in + (n + 3) / 4;
+    for(unsigned int i = 0;i < n;++i)
+        {
+        unsigned int len = ((in[i >> 2] >> ((i & 3) << 1)) & 3) + 1;
+        uint32_t v = 0;
+        for(unsigned int k = 0;k < len;++k)
+            v |= (uint32_t)data[k] << (8 * k);
+        data += len;
+        previous += (v >> 1) ^ (0U - (v & 1));
+        out[i] = previous;
+        }
+    return data;
+    }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POSTINGSHUFFLE 1
+static unsigned char postingShuffle[256][16]; // control byte -> pshufb mask
+
+__attribute__((target("ssse3")))
+static const unsigned char * decodePostingsSSSE3(const unsigned char * in,unsigned int n,uint32_t & previous,uint32_t * out)
+    {
+    const unsigned char * data = in + (n + 3) / 4;
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i last = _mm_set1_epi32((int)previous);
+    unsigned int i;
+    for(i = 0;i + 4 <= n;i += 4)
+        {
+        unsigned char control = in[i >> 2];
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data)
+                                    ,_mm_loadu_si128((const __m128i *)postingShuffle[control])
+                                    );
+        data += postingLength[control];
+        __m128i d = _mm_xor_si128(_mm_srli_epi32(v,1),_mm_sub_epi32(_mm_setzero_si128(),_mm_and_si128(v,one)));
+        d = _mm_add_epi32(d,_mm_slli_si128(d,4));
+        d = _mm_add_epi32(d,_mm_slli_si128(d,8));
+        d = _mm_add_epi32(d,last);
+        _mm_storeu_si128((__m128i *)(out + i),d);
+        last = _mm_shuffle_epi32(d,0xFF);
+        }
+    previous = (uint32_t)_mm_cvtsi128_si32(last);
+    for(;i < n;++i)
+        {
+        unsigned int len = ((in[i >> 2] >> ((i & 3) << 1)) & 3) + 1;
+        uint32_t v = 0;
+        for(unsigned int k = 0;k < len;++k)
+            v |= (uint32_t)data[k] << (8 * k);
+        data += len;
+        previous += (v >> 1) ^ (0U - (v & 1));
+        out[i] = previous;
+        }
+    return data;
+    }
+#endif
+
+static const unsigned char * (*decodePostings)(const unsigned char * in,unsigned int n,uint32_t & previous,uint32_t * out) = decodePostingsScalar;
+
+static void initPostingDecoder()
+    {
+    for(int control = 0;control < 256;++control)
+        {
+        int len = 0;
+        for(int v = 0;v < 4;++v)
+            {
+            int bytes = ((control >> (2 * v)) & 3) + 1;
+#if POSTINGSHUFFLE
+            for(int k = 0;k < 4;++k)
+                postingShuffle[control][4 * v + k] = (unsigned char)(k < bytes ? len + k : 0x80);
+#endif
+            len += bytes;
+            }
+        postingLength[control] = (unsigned char)len;
+        }
+#if POSTINGSHUFFLE
+    if(__builtin_cpu_supports("ssse3"))
+        decodePostings = decodePostingsSSSE3;
+#endif
+    }
 
-static word * words1 = NULL;
-static word ** pwordlist = NULL;
 
-static phrase ** phrases = NULL;
 
 static bool goodAllPhraseSize
     (
     word * phraseStart,
     size_t length,
     word * firstOfText,
-    word * firstOfNextText
+    word * firstOfNextText,
+    double MaxUncovered
     )
     {
     return true;
@@ -337,14 +626,13 @@ static long distanceToStartOfNextSentence(word * afterPhraseEnd,word * firstOfNe
     return dist; // 0 <= return value <= maxToTest + 1
     }
 
-static double MaxUncovered = 20;
-
 static bool goodPhraseSize
     (
     word * phraseStart,
     size_t length,
     word * firstOfText,
-    word * firstOfNextText
+    word * firstOfNextText,
+    double MaxUncovered
     )
     {
     long maxUncoveredLength = (long)(MaxUncovered * ((double)length + 0.5));
@@ -359,7 +647,8 @@ static bool goodSentenceSize
     word * phraseStart,
     size_t length,
     word * firstOfText,
-    word * firstOfNextText
+    word * firstOfNextText,
+    double MaxUncovered
     )
     {
     if(  phraseStart == firstOfText
@@ -376,48 +665,146 @@ static bool goodSentenceSize
         return false;
     }
 
-static bool (*goodSize)
+static bool goodSize
     (
+    const fuzzyness * F,
     word * phraseStart,
     size_t length,
     word * firstOfText,
     word * firstOfNextText
-    ) = goodAllPhraseSize;
+    )
+    {
+    return F->goodSize(phraseStart,length,firstOfText,firstOfNextText,F->MaxUncovered);
+    }
+
+/* Everything that depends on the weight function and the fuzzy match level:
+the counts, weights and order of the phrases and the words that they cover.
+There is a ranking for each requested combination of weight function and fuzzy
+match level. Tokens, types and the phrases found by a FindReps function are
+shared. */
+typedef struct ranking
+    {
+    ranking()
+        {
+        setWeight = NULL;
+        numberOfPhrases = 0L;
+        records = NULL;
+        phrases = NULL;
+        marked = NULL;
+        realUnmatchedFile = NULL;
+        alikeness = NULL;
+        realUnmatched = 0L;
+        fiducialTextLength = 0L;
+        reducedTextLength = 0L;
+        repetitiveness = 1.0;
+        approximate = false;
+        m = b = 0.0;
+        pages = NULL;
+        numberOfPages = 0L;
+        pagedRows = 0L;
+        }
+    void init
+        (void (*setWeight)(ranking * R,phrasekey * keys)
+        ,const fuzzyness & fuzzy
+        ,phrase * records
+        ,unsigned long numberOfPhrases
+        ,bool ownRecords // if true, copy records
+        );
+    void (*setWeight)(ranking * R,phrasekey * keys);
+    fuzzyness fuzzy;
+    unsigned long numberOfPhrases;
+    phrase * records; // discovered records, or a copy if other rankings use them
+    phrase ** phrases; // records in sorted order
+    char * marked; // _f_, _b_, _B_, _t_, _e_ for each word in words1
+    unsigned long * realUnmatchedFile; // per text
+    double * alikeness; // per text, ReductionDueToPreviousVersion()
+    unsigned long realUnmatched;
+    size_t fiducialTextLength;
+    size_t reducedTextLength;
+    double repetitiveness;
+    bool approximate; // in top-K mode: not all phrases counted
+    pageWriter * pages; // during the final recount, if there are pages
+    unsigned long numberOfPages; // written by pages
+    unsigned long pagedRows;
+    // phrase length = b + m * log(phrase #)
+    double m; // gradient
+    double b; // offset
+    } ranking;
+
+/* Writes the repeated phrases of a ranking to pages of rowsPerPage rows while
+the final recount goes on. The recount adds each repeated phrase as soon as its
+count is final. A page is handed to a thread of its own when the first phrase
+of the next page comes, or at the end, and that thread writes and closes it. */
+class pageWriter
+    {
+    typedef struct page
+        {
+        std::vector<phrase *> rows;
+        unsigned long number; // from 1
+        bool last;
+        } page;
+    analysis * A;
+    int rankingNumber; // from 1
+    std::vector<phrase *> current;
+    unsigned long numberOfPages;
+    unsigned long rows;
+    std::mutex queueLock;
+    std::condition_variable queueChanged;
+    std::deque<page> queue;
+    std::thread worker;
+    void handOver(bool last);
+    void writePage(const page & P);
+    void run();
+public:
+    pageWriter(int rankingNumber);
+    pageWriter(const pageWriter &) = delete;
+    pageWriter & operator=(const pageWriter &) = delete;
+    void add(phrase * Phrase)
+        {
+        if(current.size() == context->rowsPerPage)
+            handOver(false);
+        current.push_back(Phrase);
+        ++rows;
+        }
+    void finish(ranking * R); // writes the last page and waits until all are written
+    };
+
+/* For the recount loops: Phrase has its final count. */
+static inline void rowIsFinal(ranking * R,phrase * Phrase)
+    {
+    if(R->pages && Phrase->RealCount() > 1)
+        R->pages->add(Phrase);
+    }
 
 
 class type
     {
-    char * typestring;
+    const char * typestring; // in vocabulary
     bool is_word;
-    word ** index;
+    const unsigned char * postings; // in postingData
     unsigned long frequency;
-    phrase * phraseP;
+    phrase * phraseP; // in the arena of the analysis
 public:
-    type(): typestring(NULL),is_word(true),index(NULL),frequency(0L),phraseP(NULL)
+    type(): typestring(NULL),is_word(true),postings(NULL),frequency(0L),phraseP(NULL)
         {
         }
-    ~type()
-        {
-        delete [] typestring;
-        delete phraseP;
-        }
-    void create(char * typestring,word ** index,unsigned long frequency)
+    void create(const char * typestring,unsigned long frequency)
         {
         setName(typestring);
-        this->index = index;
         this->frequency = frequency;
         }
-    void setName(const char * typestring)
+    void setPostings(const unsigned char * postings)
+        {
+        this->postings = postings;
+        }
+    void setName(const char * typestring) // typestring must outlive this
         {
-        if(this->typestring)
-            delete [] this->typestring;
+        this->typestring = typestring;
         if(typestring)
             {
-            this->typestring = new char[strlen(typestring) + 1];
-            strcpy(this->typestring,typestring);
             int kar;
             const char * s = typestring;
-            while((kar = getUTF8char(s,globUTF8)) != 0)
+            while((kar = getUTF8char(s,context->UTF8)) != 0)
                 {
                 if(!isAlpha(kar))
                     {
@@ -426,10 +813,6 @@ public:
                     }
                 }
             }
-        else
-            {
-            this->typestring = NULL;
-            }
         }
     bool isWord() const
         {
@@ -443,9 +826,9 @@ public:
         {
         return frequency;
         }
-    word * const * getIndex() const
+    const unsigned char * getPostings() const
         {
-        return index;
+        return postings;
         }
     void addPhrase  (word * wording
                     ,ptrdiff_t offset
@@ -455,7 +838,7 @@ public:
         if(phraseP)
             phraseP->add(wording,offset,length);
         else
-            phraseP = new phrase(wording,offset,length);
+            phraseP = new(context->memory.allocate(sizeof(phrase),alignof(phrase))) phrase(wording,offset,length);
         }
     unsigned long countNumberOfPhrases()
         {
@@ -467,47 +850,6 @@ public:
             ++res;
         return res;
         }
-    unsigned long countPhrases(word * words)
-        {
-        unsigned long allcount = 0L;
-        for ( phrase * Phrase = phraseP
-            ; Phrase
-            ; Phrase = Phrase->Next()
-            )
-            {
-            word * wording = Phrase->Wording();
-            ptrdiff_t offset = Phrase->Offset();
-            size_t length = Phrase->Length();
-            unsigned long count = 0;
-            for ( word * const * q = index
-                ; q < index + frequency
-                ; q++
-                )
-                {
-                word * cand = *q - offset;
-                if  (  cand >= words // candidates can not start before begin of text
-                    && cand + length <= afterlastword
-                                    // candidates can not end after end of text
-                    && goodSize(cand,length,words,afterlastword )
-                    )
-                    {
-                    word * r, * s;
-                    for ( r = cand, s = wording
-                        ; s < wording + length && r->tp == s->tp && s->tp != NULL
-                        ; ++r,++s
-                        )
-                        ;
-                    if(s == wording + length)
-                        {
-                        ++count;
-                        }
-                    }
-                }
-            Phrase->setCount(count);
-            allcount += count;
-            }
-        return allcount;
-        }
     size_t SumOfPhraseLengths() const
         {
         size_t sumOfPhraseLengths = 0L;
@@ -532,62 +874,6 @@ public:
             }
         return sumOfPhraseLengthsTimesFrequencies;
         }
-    void setWeightAsFrequency()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequency();
-        }
-    void setWeightAsLength()
-        {
-        if(phraseP)
-            phraseP->setWeightAsLength();
-        }
-    void setWeightAsFrequencyTimesLength()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequencyTimesLength();
-        }
-    void setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
-        }
-    void setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency();
-        }
-    void setWeightAsFrequencyTimesLengthTimesAverageOfEntropy()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequencyTimesLengthTimesAverageOfEntropy();
-        }
-    void setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength();
-        }
-/*  void setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction();
-        }
-*/
-    void setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction()
-        {
-        if(phraseP)
-            phraseP->setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction();
-        }
-    void setWeight2005()
-        {
-        if(phraseP)
-            phraseP->setWeight2005();
-        }
-    void setWeight2005b()
-        {
-        if(phraseP)
-            phraseP->setWeight2005b();
-        }
     void print(FILE * fp)
         {
         fprintf(fp,"<%s>x%ld\n",typestring,frequency);
@@ -597,53 +883,147 @@ public:
             )
             Phrase->print(fp);
         }
-    void setPhrasesInArray(phrase *** curPhrase)
+    void movePhrasesToArray(phrase ** curRecord)
         {
         for ( phrase * Phrase = phraseP
             ; Phrase
             ; Phrase = Phrase->Next()
             )
             {
-            **curPhrase = Phrase;
-            ++*curPhrase;
+            Phrase->copyTo(*curRecord);
+            ++*curRecord;
             }
+        phraseP = NULL;
         }
     };
 
-charprop character[256];
+/* Decodes the posting list of a type a block at a time:
 
-static bool isSentenceDelimiter(type * Type)
+    for(postingBlocks block(Type);block.next();)
+        for(const uint32_t * q = block.begin();q < block.end();++q)
+            ... context->words1[*q] ...
+
+The loops index words1, tokenIds and the markings with the positions
+themselves, so a block is not turned into word pointers first. */
+class postingBlocks
     {
-    unsigned char x = (unsigned char)Type->name()[0];
-    return character[x] == sentence_delimiter;
-//    return x == '.' || x == '?' || x == ';' || x == '!';
+    const unsigned char * data; // next block
+    unsigned long left; // positions in the blocks from data on
+    uint32_t previous;
+    unsigned int n; // positions in the current block
+    uint32_t position[POSTINGBLOCK];
+public:
+    postingBlocks(const type * Type):data(Type->getPostings()),left(Type->getFrequency()),previous(0),n(0)
+        {
+        }
+    bool next()
+        {
+        if(left == 0)
+            return false;
+        n = left < POSTINGBLOCK ? (unsigned int)left : POSTINGBLOCK;
+        left -= n;
+        data = decodePostings(data,n,previous,position);
+        return true;
+        }
+    const uint32_t * begin() const
+        {
+        return position;
+        }
+    const uint32_t * end() const
+        {
+        return position + n;
+        }
+    };
+
+/* Phrase verification. The types of the tokens are also kept as type numbers
+in tokenIds, parallel to words1, so that a candidate occurrence of a phrase can
+be compared with the phrase KERNELWIDTH tokens at a time. tokenIds and the
+markings of a ranking have KERNELWIDTH - 1 entries of padding at the end.
+16-bit type numbers, with the rarest types sharing one number and compared by
+type, were tried and were no faster. */
+#define KERNELWIDTH 8
+#define NOTYPE UINT32_MAX // a token without type
+
+
+static bool samePhrase(size_t cand,size_t wording,size_t length,const char * marked)
+    // True if the length tokens from position cand have the types of the
+    // tokens from position wording, which must all have a type. If marked is
+    // not NULL, the tokens from cand must also all be marked _f_.
+    {
+    const uint32_t * c = context->tokenIds + cand;
+    const uint32_t * w = context->tokenIds + wording;
+    const char * m = marked ? marked + cand : NULL;
+    if(c[0] != w[0]) // by far the most common mismatch
+        return false;
+#if defined(__SSE2__)
+    const __m128i free = _mm_set1_epi8(_f_);
+    for(size_t i = 0;i < length;i += KERNELWIDTH)
+        {
+        unsigned int lanes = length - i < KERNELWIDTH ? (1U << (length - i)) - 1 : (1U << KERNELWIDTH) - 1;
+#if defined(__AVX2__)
+        __m256i ws = _mm256_loadu_si256((const __m256i *)(w + i));
+        __m256i same = _mm256_andnot_si256(_mm256_cmpeq_epi32(ws,_mm256_set1_epi32(-1))
+                                          ,_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(c + i)),ws)
+                                          );
+        unsigned int equal = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(same));
+#else
+        const __m128i notype = _mm_set1_epi32(-1);
+        __m128i w0 = _mm_loadu_si128((const __m128i *)(w + i));
+        __m128i w1 = _mm_loadu_si128((const __m128i *)(w + i + 4));
+        __m128i same0 = _mm_andnot_si128(_mm_cmpeq_epi32(w0,notype),_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(c + i)),w0));
+        __m128i same1 = _mm_andnot_si128(_mm_cmpeq_epi32(w1,notype),_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(c + i + 4)),w1));
+        unsigned int equal = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(same0))
+                           | (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(same1)) << 4;
+#endif
+        if(m)
+            equal &= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadl_epi64((const __m128i *)(m + i)),free));
+        if((equal & lanes) != lanes)
+            return false;
+        }
+    return true;
+#else
+    for(size_t i = 0;i < length;++i)
+        if(c[i] != w[i] || w[i] == NOTYPE || (m && m[i] != _f_))
+            return false;
+    return true;
+#endif
     }
 
-static char * doubleslash(char * s)
+static void prefetchCandidate(const uint32_t * q,const uint32_t * end,ptrdiff_t offset,const char * marked)
+    // Prefetches the ids and markings of the candidate after *q.
     {
-    static char buf[500];
-    char *d = buf;
-    while(*s)
+#if defined(__GNUC__)
+    if(q + 1 < end)
         {
-        if(*s == '\\')
-            *d++ = '\\';
-        *d++ = *s++;
+        ptrdiff_t next = (ptrdiff_t)q[1] - offset;
+        if(next >= 0)
+            {
+            __builtin_prefetch(context->tokenIds + next);
+            if(marked)
+                __builtin_prefetch(marked + next);
+            }
         }
-    *d = '\0';
-    return buf;
+#endif
+    }
+
+
+static bool isSentenceDelimiter(type * Type)
+    {
+    unsigned char x = (unsigned char)Type->name()[0];
+    return context->character[x] == sentence_delimiter;
+//    return x == '.' || x == '?' || x == ';' || x == '!';
     }
 
-static long inpos = 0L;
 #if 0
 static char * writePhraseRTF(word * start,word * end)
     {
     static char markedfile[L_tmpnam];
     word * i;
     bool endofcode = false;
-    if(!filedatalist)
+    if(!context->filedatalist)
         return NULL;
     tmpnam(markedfile);
-    filedata * pfile = filedatalist;
+    filedata * pfile = context->filedatalist;
     FILE * fpi = NULL;
     FILE * fpo = fopen(markedfile/*"marked.txt"*/,"wb");
 // WordPad header:
@@ -670,13 +1050,13 @@ static char * writePhraseRTF(word * start,word * end)
         {
         if(i == pfile->boundary)
             {
-            fprintf(fpo,
-    "\\par \\par \\plain\\f4\\fs20\\cf2 FILE %s \\plain\\f2\\fs20 \\par \\par ",
-                    doubleslash(pfile->filename));
+            fprintf(fpo,"\\par \\par \\plain\\f4\\fs20\\cf2 FILE ");
+            writeDoubleslashed(fpo,pfile->filename);
+            fprintf(fpo," \\plain\\f2\\fs20 \\par \\par ");
             if(fpi)
                 fclose(fpi);
             fpi = fopen(pfile->filename,"rb");
-            inpos = 0L;
+            context->inpos = 0L;
             ++pfile;
             }
         assert(fpi != NULL);
@@ -687,10 +1067,10 @@ static char * writePhraseRTF(word * start,word * end)
                 endofcode = false;
                 fprintf(fpo," |");
                 }
-            while(inpos < i->fileStartPos)
+            while(context->inpos < i->fileStartPos)
                     {
                     int kar = fgetc(fpi);
-                    inpos++;
+                    context->inpos++;
                     if(kar == '\n')
                             count += fprintf(fpo,"\n\\par ");
                     else
@@ -707,48 +1087,48 @@ static char * writePhraseRTF(word * start,word * end)
             {
 #ifdef UNNECESSARYSTUFF
             const char * s = words[i]->name();
-            if(!strcmp(s,"\\a") && character[(unsigned int)'\a'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\a") && context->character[(unsigned int)'\a'] == control_character_to_be_kept)
                 count += fprintf(fpo,"%c",'\a');
             else
-            if(!strcmp(s,"\\b") && character[(unsigned int)'\b'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\b") && context->character[(unsigned int)'\b'] == control_character_to_be_kept)
                 count += fprintf(fpo,"%c",'\b');
             else
-            if(!strcmp(s,"\\f") && character[(unsigned int)'\f'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\f") && context->character[(unsigned int)'\f'] == control_character_to_be_kept)
                 {
                 fprintf(fpo,"%c",'\f');
                 count = 0;
                 }
             else
-            if(!strcmp(s,"\\n") && character[(unsigned int)'\n'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\n") && context->character[(unsigned int)'\n'] == control_character_to_be_kept)
                 {
                 fprintf(fpo,"%c",'\\par ');
                 count = 0;
                 }
             else
-            if(!strcmp(s,"\\r") && character[(unsigned int)'\r'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\r") && context->character[(unsigned int)'\r'] == control_character_to_be_kept)
                 {
                 fprintf(fpo,"%c",'\r');
                 count = 0;
                 }
             else
-            if(!strcmp(s,"\\t") && character[(unsigned int)'\t'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\t") && context->character[(unsigned int)'\t'] == control_character_to_be_kept)
                 {
                 fprintf(fpo,"%c",'\t');
                 count += 8;
                 }
             else
-            if(!strcmp(s,"\\v") && character[(unsigned int)'\v'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\v") && context->character[(unsigned int)'\v'] == control_character_to_be_kept)
                 fprintf(fpo,"%c",'\v');
             else
-            if(!strcmp(s,"\\\\") && character[(unsigned int)'\\'] == control_character_to_be_kept)
+            if(!strcmp(s,"\\\\") && context->character[(unsigned int)'\\'] == control_character_to_be_kept)
                 count += fprintf(fpo,"%c",'\\\\');
             else
 #endif
                 {
-                while(inpos < i->fileEndPos)
+                while(context->inpos < i->fileEndPos)
                         {
                         int kar = fgetc(fpi);
-                        inpos++;
+                        context->inpos++;
                         if(kar == '\n')
                                 count += fprintf(fpo,"\n\\par ");
                         else
@@ -780,136 +1160,144 @@ static char * writePhraseRTF(word * start,word * end)
 
 void header(FILE * fpo,const char * title)
     {
-    fprintf(fpo,
-        "<?xml version=\"1.0\" encoding=\"%s\" ?>\n"
-        "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Strict//EN\" "
-        "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-strict.dtd\">\n"
-        "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
-        "<head>\n"
-        "<title></title>\n"
-        "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=%s\"/>\n"
-        "<style type=\"text/css\">"
-        "span { background-color: Silver; } </style>"
-        "</head>\n"
-        "<body>\n",
-        globUTF8 ? "UTF-8" : "ISO-8859-1",
-        globUTF8 ? "UTF-8" : "ISO-8859-1"
-        );
+    writeHTMLHeader(fpo,context->UTF8);
     }
 
+/* Copies text[inpos,end) of pfile to out, with line breaks as <br />. */
+static void writeTextHTML(const filedata * pfile,size_t & inpos,long end,gatherBuffer & out)
+    {
+    writeTextHTML(out,pfile->text,inpos,end < (long)pfile->length ? (size_t)end : pfile->length);
+    }
 
-static char ** writePhraseHTML(word * start,word * end)
+/* Writes the name of pfile as a heading and its text as a paragraph, with the
+repeated phrases as spans. */
+static bool writeMarkedSection(const char * marked,const filedata * pfile,FILE * fpo)
     {
-    char ** ret = new char * [2];
-    ret[1] = NULL;
-    int nfiles = 1;
-    static char markedfile[1000];
-    word * i;
+    size_t inpos = 0;
     bool endofcode = false;
-    if(!filedatalist)
-        return NULL;
-    filedata * pfile = filedatalist;
-    FILE * fpi = NULL;
-
-    int count = 0;
-    while(pfile->boundary < start)
-        ++pfile;
-    FILE * fpo = NULL;
-    for(i = start;i <= end;++i)
+    fprintf(fpo,"<h1>");
+    writeDoubleslashed(fpo,pfile->filename);
+    fprintf(fpo,"</h1><p>\n");
+    gatherBuffer out(fpo);
+    for(word * i = pfile->boundary;i < pfile[1].boundary;++i)
         {
-        if(i == pfile->boundary)
-            {
-            if(fpo)
-                {
-                ++nfiles;
-                char ** nret = new char * [nfiles+1];
-                for(int i = 0;i < nfiles;++i)
-                    {
-                    nret[i+1] = ret[i];
-                    }
-                delete [] ret;
-                ret = nret;
-                fprintf(fpo,"</p>");
-                fprintf(fpo,"%s\n",
-                    "</body>\n"
-                    "</html>\n");
-                fclose(fpo);
-                }
-            sprintf(markedfile,"%s.html",pfile->filename);
-            ret[0] = new char[strlen(markedfile)+1];
-            strcpy(ret[0],markedfile);
-            fpo = fopen(markedfile/*"marked.txt"*/,"wb");
-            if(!fpo)
-                return NULL;
-            header(fpo,pfile->filename);
-            fprintf(fpo,"<h1>%s</h1><p>\n",doubleslash(pfile->filename));
-            if(fpi)
-                fclose(fpi);
-            fpi = fopen(pfile->filename,"rb");
-            inpos = 0L;
-            ++pfile;
-            }
-        assert(fpi != NULL);
-        if(i->marked & _b_)
+        if(marked[i - context->words1] & _b_)
             {
             if(endofcode)
                 {
                 endofcode = false;
-                fprintf(fpo," |");
-                }
-            while(inpos < i->fileStartPos)
-                {
-                int kar = fgetc(fpi);
-                inpos++;
-                if(kar == '\n')
-                    count += fprintf(fpo,"<br />\n");
-                else
-                    {
-                    ++count;
-                    fputc(kar,fpo);
-                    }
+                out.put(" |",2);
                 }
-            fprintf(fpo,"<span>");
+            writeTextHTML(pfile,inpos,i->fileStartPos,out);
+            out.put("<span>",6);
             }
         else
             {
             endofcode = false;
             }
         if(i->tp)
-            {
-            while(inpos < i->fileEndPos)
-                {
-                int kar = fgetc(fpi);
-                inpos++;
-                if(kar == '\n')
-                    count += fprintf(fpo,"<br />\n");
-                else
-                    {
-                    ++count;
-                    fputc(kar,fpo);
-                    }
-                }
-            }
+            writeTextHTML(pfile,inpos,i->fileEndPos,out);
         else
-            count += fprintf(fpo,"<h2> XXX</h2>\n");
-        if (i->marked & _e_)
+            out.put("<h2> XXX</h2>\n");
+        if (marked[i - context->words1] & _e_)
             {
-            fprintf(fpo,"</span>");
+            out.put("</span>",7);
             endofcode = true;
             }
         }
-    if(fpo)
-        {
-        fprintf(fpo,"</p>");
-        fprintf(fpo,"%s\n",
-            "</body>\n"
-            "</html>\n");
-        fclose(fpo);
-        }
-    return ret;
+    out.put("</p>",4);
+    out.flush();
+    return out.ok();
     }
 
-static bool FindRepOfPhrase(word * startofphrase,word * endofphrase,/*bool & UniqueWord,*/ word *& PosOfUniqueWord)
+/* Writes the text of pfile as HTML, with the repeated phrases as spans. */
+static bool writeMarkedHTML(const char * marked,const filedata * pfile,FILE * fpo)
+    {
+    header(fpo,pfile->filename);
+    bool written = writeMarkedSection(marked,pfile,fpo);
+    fprintf(fpo,"%s\n",
+        "</body>\n"
+        "</html>\n");
+    return written;
+    }
+
+/* Writes all texts that have tokens to one HTML document, each under its
+name. For many small texts, this saves a file per text. */
+static bool writeCombinedHTML(const char * marked,FILE * fpo)
+    {
+    bool written = true;
+    header(fpo,"marked texts");
+    for(int fileno = 0;fileno < context->numberOfFiles;++fileno)
+        {
+        const filedata * pfile = context->filedatalist + fileno;
+        if(pfile->boundary != pfile[1].boundary && !writeMarkedSection(marked,pfile,fpo))
+            written = false;
+        fputc('\n',fpo);
+        }
+    fprintf(fpo,"%s\n",
+        "</body>\n"
+        "</html>\n");
+    return written;
+    }
+
+/* Writes each text that has tokens to <name>.html. The texts are independent,
+so each thread takes the next text until all are written. Returns the names of
+the written files, in the order of the texts, up to the first that could not
+be opened or written. */
+static char ** writePhraseHTML(const char * marked)
+    {
+    if(!context->filedatalist)
+        return NULL;
+    int numberOfFiles = context->numberOfFiles;
+    char ** ret = new char * [numberOfFiles + 1];
+    bool * failed = new bool[numberOfFiles];
+    std::atomic<int> nextFile(0);
+    unsigned long nthreads = numberOfThreads();
+    if(nthreads > (unsigned long)numberOfFiles)
+        nthreads = numberOfFiles;
+    parallelForAnalysis(nthreads,1,[&](unsigned long,unsigned long)
+        {
+        int fileno;
+        while((fileno = nextFile++) < numberOfFiles)
+            {
+            const filedata * pfile = context->filedatalist + fileno;
+            ret[fileno] = NULL;
+            failed[fileno] = false;
+            if(pfile->boundary == pfile[1].boundary)
+                continue;
+            const char * suffix = compressionSuffix(context->markedCompression);
+            char * markedfile = new char[strlen(pfile->filename) + sizeof(".html") + strlen(suffix)];
+            sprintf(markedfile,"%s.html%s",pfile->filename,suffix);
+            FILE * fpo = compressingStream(fopen(markedfile/*"marked.txt"*/,"wb"),context->markedCompression);
+            if(!fpo)
+                {
+                delete [] markedfile;
+                failed[fileno] = true;
+                continue;
+                }
+            bool written = writeMarkedHTML(marked,pfile,fpo);
+            if(fclose(fpo) != 0 || !written)
+                {
+                delete [] markedfile;
+                failed[fileno] = true;
+                continue;
+                }
+            ret[fileno] = markedfile;
+            }
+        });
+    int nfiles = 0;
+    int fileno;
+    for(fileno = 0;fileno < numberOfFiles && !failed[fileno];++fileno)
+        if(ret[fileno])
+            ret[nfiles++] = ret[fileno];
+    for(;fileno < numberOfFiles;++fileno)
+        delete [] ret[fileno];
+    ret[nfiles] = NULL;
+    delete [] failed;
+    return ret;
+    }
+
+static bool FindRepOfPhrase(word * startofphrase,word * endofphrase,/*bool & UniqueWord,*/ word *& PosOfUniqueWord)
     {
     word *  i, * lowi = NULL;
     unsigned long lowfreq = ULONG_MAX;
@@ -929,38 +1317,31 @@ static bool FindRepOfPhrase(word * startofphrase,word * endofphrase,/*bool & Uni
         }
     ptrdiff_t offset = lowi - startofphrase;
     type * LeastFrequentType = lowi->tp;
-    word * const * plong = LeastFrequentType->getIndex();
     bool found = false;
-    for ( word * const * q = plong
-        ; q < plong + lowfreq && !found
-        ; q++
-        )
-        {
-        word * cand = *q - offset;
-        if  (  *q != lowi // phrase does not repeat with itself
-            && cand >= words1 // candidates can not start before begin of text
-                           // text starts at 1, not at 0, so if offset = 0
-                           // then *q must be at least 1.
-            && cand + (endofphrase - startofphrase) <= lastword
-                            // candidates can not end after end of text
+    for(postingBlocks block(LeastFrequentType);!found && block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end() && !found
+            ; q++
             )
             {
-            word * r, * s;
-            for ( r = cand, s = startofphrase
-                ; s <= endofphrase && r->tp == s->tp && s->tp != NULL
-                ; ++r,++s
+            ptrdiff_t first = (ptrdiff_t)*q - offset;
+            prefetchCandidate(q,block.end(),offset,NULL);
+            if  (  context->words1 + *q != lowi // phrase does not repeat with itself
+                && first >= 0 // candidates can not start before begin of text
+                && first + (endofphrase - startofphrase) <= context->lastword - context->words1
+                                // candidates can not end after end of text
                 )
-                ;
-            if(s == endofphrase + 1)
                 {
-                found = true;
-                LeastFrequentType->addPhrase(*q - offset
-                    ,offset
-                    ,(endofphrase + 1) - startofphrase
-                    );
+                if(samePhrase(first,startofphrase - context->words1,(endofphrase + 1) - startofphrase,NULL))
+                    {
+                    found = true;
+                    LeastFrequentType->addPhrase(context->words1 + first
+                        ,offset
+                        ,(endofphrase + 1) - startofphrase
+                        );
+                    }
                 }
             }
-        }
     return found;
     }
 
@@ -970,7 +1351,7 @@ static void FindRepsWithinSentence(word * startofsentence,word * endofsentence,b
     //bool UniqueWord = false;
     for( start = startofsentence
 //       ;    start < endofsentence
-       ;    start + minlimit - 1 <= endofsentence
+       ;    start + context->minlimit - 1 <= endofsentence
          && PosOfUniqueWord == NULL //!UniqueWord
        ;
        )
@@ -982,11 +1363,11 @@ static void FindRepsWithinSentence(word * startofsentence,word * endofsentence,b
           )
             {
             word * theEnd = endofsentence;
-            if(maxlimit > 0 && theEnd - start > maxlimit - 1)
-               theEnd = start + maxlimit - 1;
+            if(context->maxlimit > 0 && theEnd - start > context->maxlimit - 1)
+               theEnd = start + context->maxlimit - 1;
             for(end = theEnd // endofsentence
 #ifdef ALLOWONEWORDPHRASES
-               ;    end >= start + minlimit - 1   // Bart 20010515: Quick hack to include
+               ;    end >= start + context->minlimit - 1   // Bart 20010515: Quick hack to include
                                    // phrases (terms) of only one word
 #else
                ;    end > start
@@ -1067,40 +1448,33 @@ static void FindRepsAsSentence(word * startofsentence,word * endofsentence,bool
             {
             ptrdiff_t offset = lowi - startofsentence;
             type * LeastFrequentType = lowi->tp;
-            word * const * plong = LeastFrequentType->getIndex();
             bool found = false;
 
-            for ( word * const * q = plong
-                ; q < plong + lowfreq && !found
-                ; q++
-                )
-                {
-                word * cand = *q - offset;
-                if  (  *q != lowi // phrase does not repeat with itself
-                    && cand >= words1 // candidates can not start before begin of text
-                                   // text starts at 1, not at 0, so if offset = 0
-                                   // then *q must be at least 1.
-                    && cand + (endofsentence - startofsentence) <= lastword
-                                    // candidates can not end after end of text
-                    && goodSize(cand,(endofsentence - startofsentence) + 1,words1/*firstOfText*/,afterlastword /*firstOfNextText*/)
+            for(postingBlocks block(LeastFrequentType);!found && block.next();)
+                for ( const uint32_t * q = block.begin()
+                    ; q < block.end() && !found
+                    ; q++
                     )
                     {
-                    word * r, * s;
-                    for ( r = cand, s = startofsentence
-                        ; s <= endofsentence && r->tp == s->tp && s->tp != NULL
-                        ; ++r,++s
+                    ptrdiff_t first = (ptrdiff_t)*q - offset;
+                    prefetchCandidate(q,block.end(),offset,NULL);
+                    if  (  context->words1 + *q != lowi // phrase does not repeat with itself
+                        && first >= 0 // candidates can not start before begin of text
+                        && first + (endofsentence - startofsentence) <= context->lastword - context->words1
+                                        // candidates can not end after end of text
+                        && goodSentenceSize(context->words1 + first,(endofsentence - startofsentence) + 1,context->words1/*firstOfText*/,context->afterlastword /*firstOfNextText*/,0.0)
                         )
-                        ;
-                    if(s == endofsentence + 1)
                         {
-                        found = true;
-                        LeastFrequentType->addPhrase(*q - offset
-                            ,offset
-                            ,(endofsentence + 1) - startofsentence
-                            );
+                        if(samePhrase(first,startofsentence - context->words1,(endofsentence + 1) - startofsentence,NULL))
+                            {
+                            found = true;
+                            LeastFrequentType->addPhrase(context->words1 + first
+                                ,offset
+                                ,(endofsentence + 1) - startofsentence
+                                );
+                            }
                         }
                     }
-                }
 //            success = found;
             }
         }
@@ -1108,24 +1482,47 @@ static void FindRepsAsSentence(word * startofsentence,word * endofsentence,bool
 //        unmatched += endofsentence - startofsentence + 1;
     }
 
-static void (*FindReps)(word * startofsentence,word * endofsentence,bool startOK,bool endOK) =
-    FindRepsWithinSentence;
+static fuzzyness fuzzynessLevel(int perc)
+    {
+    fuzzyness F;
+    F.boundary = perc;
+    F.MaxUncovered = 20;
+    switch(perc)
+        {
+        case 100:
+            F.FindReps = FindRepsAsSentence;
+            F.goodSize = goodSentenceSize;
+            break;
+        case 0:
+            F.FindReps = FindRepsWithinSentence;
+            F.goodSize = goodAllPhraseSize;
+            break;
+        default:
+            F.FindReps = FindRepsWithinSentence;
+            F.goodSize = goodPhraseSize;
+            F.MaxUncovered = (100.0/(double)perc) - 1.0;
+            break;
+        }
+    return F;
+    }
+
 
 
-static unsigned long Repetitions()
+static unsigned long Repetitions(discovery * D)
     {
-    if(typeArray && words1 && pwordlist)
+    void (*FindReps)(word * startofsentence,word * endofsentence,bool startOK,bool endOK) = D->FindReps;
+    if(context->typeArray && context->words1 && context->postingData)
         {
         word * wordindex;
-        word * startofsentence = words1;
+        word * startofsentence = context->words1;
         unsigned long i;
 //        int fileno = 0;
-        filedata * pfile = filedatalist;
+        filedata * pfile = context->filedatalist;
 //        unmatched = 0L;
-        numberOfPhrases = 0L;
-        numberOfSentenceSeparators = 0L;
+        unsigned long numberOfPhrases = 0L;
+        context->numberOfSentenceSeparators = 0L;
         pfile->numberOfSentenceSeparators = 0L;
-        for(wordindex = words1;wordindex <= lastword;wordindex++)
+        for(wordindex = context->words1;wordindex <= context->lastword;wordindex++)
             {
             type * Type;
             if((Type = wordindex->tp) != NULL)
@@ -1134,7 +1531,7 @@ static unsigned long Repetitions()
                     {
                     FindReps(startofsentence,wordindex - 1,true,true); // -1 because we do not include the separator
                     startofsentence = wordindex + 1;
-                    ++numberOfSentenceSeparators;
+                    ++context->numberOfSentenceSeparators;
                     ++(pfile->numberOfSentenceSeparators);
                     }
                 else if(wordindex >= (pfile+1)->boundary)
@@ -1151,170 +1548,291 @@ static unsigned long Repetitions()
 				}
             }
         for ( i = 0
-            ; i < types
+            ; i < context->types
             ; ++i
             )
-            numberOfPhrases += typeArray[i].countNumberOfPhrases();
-        if(phrases)
-            delete [] phrases;
-        phrases = new phrase * [numberOfPhrases];
-        phrase ** curPhrase = phrases;
+            numberOfPhrases += context->typeArray[context->nameOrder[i]].countNumberOfPhrases();
+        D->records = context->memory.newArray<phrase>(numberOfPhrases);
+        D->numberOfPhrases = numberOfPhrases;
+        phrase * curRecord = D->records;
         for ( i = 0
-            ; i < types
+            ; i < context->types
             ; ++i
             )
-            typeArray[i].setPhrasesInArray(&curPhrase);
+            context->typeArray[context->nameOrder[i]].movePhrasesToArray(&curRecord);
         return numberOfPhrases;
         }
     return 0L;
     }
 
-static unsigned long CountRepetitions()
+#define PHRASESPERTHREAD 50000
+
+static void CountRepetitions(ranking * R)
+    {
+    if(R->records && context->words1 && context->postingData)
+        {
+        parallelForAnalysis(R->numberOfPhrases,PHRASESPERTHREAD,[R](unsigned long first,unsigned long last)
+            {
+            for(unsigned long i = first;i < last;++i)
+                R->records[i].countOccurrences(&R->fuzzy);
+            });
+        }
+    }
+
+void ranking::init
+        (void (*setWeight)(ranking * R,phrasekey * keys)
+        ,const fuzzyness & fuzzy
+        ,phrase * records
+        ,unsigned long numberOfPhrases
+        ,bool ownRecords
+        )
     {
-    unsigned long result = 0L;
     unsigned long i;
-    if(typeArray && words1 && pwordlist)
+    this->setWeight = setWeight;
+    this->fuzzy = fuzzy;
+    this->numberOfPhrases = numberOfPhrases;
+    if(ownRecords)
         {
+        this->records = context->memory.newArray<phrase>(numberOfPhrases);
         for ( i = 0
-            ; i < types
+            ; i < numberOfPhrases
             ; ++i
             )
-            result += typeArray[i].countPhrases(words1);
+            records[i].copyTo(this->records + i);
         }
-    return result;
+    else
+        this->records = records;
+    phrases = context->memory.newArray<phrase *>(numberOfPhrases);
+    for ( i = 0
+        ; i < numberOfPhrases
+        ; ++i
+        )
+        phrases[i] = this->records + i;
+    marked = context->memory.newArray<char>((context->afterlastword - context->words1) + KERNELWIDTH - 1);
+    memset(marked + (context->afterlastword - context->words1),0,KERNELWIDTH - 1);
+    realUnmatchedFile = context->memory.newArray<unsigned long>(context->numberOfFiles + 1); // like filedatalist
+    alikeness = context->memory.newArray<double>(context->numberOfFiles);
     }
 
-static void CountRealUnMatched()
+static void CountRealUnMatched(ranking * R)
     {
     word * i;
-    filedata * pfile = filedatalist;
-    realUnmatched = 0L;
-    pfile->realUnmatched = 0;
-    for ( i = words1
-        ; i <= lastword
+    filedata * pfile = context->filedatalist;
+    unsigned long * pUnmatched = R->realUnmatchedFile;
+    R->realUnmatched = 0L;
+    *pUnmatched = 0;
+    for ( i = context->words1
+        ; i <= context->lastword
         ;
         )
         {
-        if(i->marked == _f_)
+        if(R->marked[i - context->words1] == _f_)
             {
-            ++realUnmatched;
-            ++(pfile->realUnmatched);
+            ++R->realUnmatched;
+            ++(*pUnmatched);
             }
         ++i;
         if(i == (pfile+1)->boundary)
             {
-            pfile->realUnmatched -= pfile->numberOfSentenceSeparators;
-            (++pfile)->realUnmatched = 0;
+            *pUnmatched -= pfile->numberOfSentenceSeparators;
+            ++pfile;
+            *++pUnmatched = 0;
             }
         }
-    realUnmatched -= numberOfSentenceSeparators;
-    pfile->realUnmatched -= pfile->numberOfSentenceSeparators;
+    R->realUnmatched -= context->numberOfSentenceSeparators;
+    *pUnmatched -= pfile->numberOfSentenceSeparators;
     }
 
-static unsigned long CountRepetitionsBetter()
+static unsigned long CountRepetitionsBetter(ranking * R)
     {
     unsigned long result = 0L;
     unsigned long i;
-    for(i = 0;words1 + i <= lastword;++i)
-        words1[i].marked = _f_;
-    if(phrases && words1)
+    memset(R->marked,_f_,context->afterlastword - context->words1);
+    if(R->phrases && context->words1)
         {
         for ( i = 0
-            ; i < numberOfPhrases
+            ; i < R->numberOfPhrases
             ; ++i
             )
-            result += phrases[i]->countPhrase(words1,true);
+            {
+            result += R->phrases[i]->countPhrase(R,true);
+            rowIsFinal(R,R->phrases[i]);
+            }
         }
-    CountRealUnMatched();
+    CountRealUnMatched(R);
     return result;
     }
 
-static unsigned long CountRepetitionsInTextsBetter()
+static filedata * textContaining(word * w)
     {
-    unsigned long result = 0L
-#ifdef  NDEBUG
-#else
-		, saveresult
-#endif		
-		;// = 0L;
-    unsigned long i;
-    for(i = 0;words1 + i <= lastword;++i)
-        words1[i].marked = _f_;
-    if(phrases && words1)
+    int low = 0;
+    int high = context->numberOfFiles; // filedatalist[numberOfFiles].boundary == afterlastword
+    while(high - low > 1)
         {
-        for ( i = 0
-            ; i < numberOfPhrases
-            ; ++i
+        int mid = (low + high) / 2;
+        if(context->filedatalist[mid].boundary <= w)
+            low = mid;
+        else
+            high = mid;
+        }
+    return context->filedatalist + low;
+    }
+
+static int textsToConfirm()
+    // The number of texts before the first one that starts at afterlastword.
+    // countPhraseInAllTexts stops there and confirms the phrase, so trailing
+    // empty texts do not count.
+    {
+    int f = 0;
+    while(f < context->numberOfFiles && context->filedatalist[f].boundary != context->afterlastword)
+        ++f;
+    return f;
+    }
+
+static bool occursInAllTexts(ranking * R,phrase * Phrase,unsigned long * textStamp,unsigned long stamp,int texts)
+    // Cheap test that does not touch the markings: a phrase that has no
+    // unmarked occurrence in one of the first texts (see textsToConfirm) is
+    // rejected by CountRepetitionsInTextsBetter anyway, after marking and
+    // unmarking all occurrences in the preceding texts.
+    {
+    if(texts == 0)
+        return true;
+    word * wording = Phrase->Wording();
+    ptrdiff_t offset = Phrase->Offset();
+    size_t length = Phrase->Length();
+    int textsWithPhrase = 0;
+    filedata * end = context->filedatalist + texts;
+    size_t at = wording - context->words1;
+    for(postingBlocks block(wording[offset].tp);block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end()
+            ; q++
             )
             {
-            int count;
-            filedata * pfile = filedatalist;
-#ifdef  NDEBUG
-#else
-            saveresult = result;
-#endif
-            for(
-               ;    ( pfile->boundary != afterlastword /*0xffffffff*/ )
-                 && (  ( count
-                       = phrases[i]->countPhraseInText
-                        (pfile == filedatalist,pfile->boundary,(pfile+1)->boundary)
-                       )
-                    != 0
-                    )
-               ;pfile++
-               )
-                {
-                result += count;
-                }
-            if(pfile->boundary == afterlastword /*0xffffffff*/)
-                for(;--pfile >= filedatalist;)
-                    phrases[i]->confirmPhraseInText(pfile->boundary,(pfile+1)->boundary);
-            else
+            ptrdiff_t first = (ptrdiff_t)*q - offset;
+            prefetchCandidate(q,block.end(),offset,R->marked);
+            if(first < 0)
+                continue;
+            word * cand = context->words1 + first;
+            filedata * pfile = textContaining(cand);
+            if(  pfile < end
+              && textStamp[pfile - context->filedatalist] != stamp
+              && cand + length <= (pfile+1)->boundary
+              && goodSize(&R->fuzzy,cand,length,pfile->boundary,(pfile+1)->boundary)
+              )
                 {
-                for(;--pfile >= filedatalist;)
+                if(samePhrase(first,at,length,R->marked))
                     {
-                    result -= phrases[i]->uncountPhraseInText
-                       (pfile->boundary,(pfile+1)->boundary);
-/*                    FILE * fp = fopen("\\LOG","a");
-                    phrases[i]->print(fp);
-                    fclose(fp);
-*/
+                    textStamp[pfile - context->filedatalist] = stamp;
+                    if(++textsWithPhrase == texts)
+                        return true;
                     }
-                assert(result == saveresult);// something wrong?
-/*              if(result != saveresult)
-                    result = saveresult;   // put breakpoint here, this is WRONG
-*/
                 }
             }
+    return false;
+    }
+
+static unsigned long countPhraseInAllTexts(ranking * R,phrase * Phrase,unsigned long * textStamp,unsigned long stamp,int texts)
+    // Marks the occurrences of Phrase if it occurs in all texts. Otherwise
+    // leaves the markings as they were. Returns the number of occurrences
+    // marked. texts is textsToConfirm().
+    {
+    unsigned long result = 0L;
+    if(!occursInAllTexts(R,Phrase,textStamp,stamp,texts))
+        {
+        Phrase->setRealCount(0L);
+        return 0L;
+        }
+    int count;
+    filedata * pfile = context->filedatalist;
+    for(
+       ;    ( pfile->boundary != context->afterlastword /*0xffffffff*/ )
+         && (  ( count
+               = Phrase->countPhraseInText
+                (R,pfile == context->filedatalist,pfile->boundary,(pfile+1)->boundary)
+               )
+            != 0
+            )
+       ;pfile++
+       )
+        {
+        result += count;
+        }
+    if(pfile->boundary == context->afterlastword /*0xffffffff*/)
+        for(;--pfile >= context->filedatalist;)
+            Phrase->confirmPhraseInText(R,pfile->boundary,(pfile+1)->boundary);
+    else
+        {
+        for(;--pfile >= context->filedatalist;)
+            {
+            result -= Phrase->uncountPhraseInText
+               (R,pfile->boundary,(pfile+1)->boundary);
+/*            FILE * fp = fopen("\\LOG","a");
+            Phrase->print(fp);
+            fclose(fp);
+*/
+            }
+        assert(result == 0L);// something wrong?
+        }
+    return result;
+    }
+
+static unsigned long * newTextStamps()
+    {
+    unsigned long * textStamp = new unsigned long[context->numberOfFiles];
+    for(int f = 0;f < context->numberOfFiles;++f)
+        textStamp[f] = 0L;
+    return textStamp;
+    }
+
+static unsigned long CountRepetitionsInTextsBetter(ranking * R)
+    {
+    unsigned long result = 0L;
+    unsigned long i;
+    phrase ** phrases = R->phrases;
+    memset(R->marked,_f_,context->afterlastword - context->words1);
+    if(phrases && context->words1)
+        {
+        unsigned long * textStamp = newTextStamps();
+        int texts = textsToConfirm();
+        for ( i = 0
+            ; i < R->numberOfPhrases
+            ; ++i
+            )
+            {
+            result += countPhraseInAllTexts(R,phrases[i],textStamp,i + 1,texts);
+            rowIsFinal(R,phrases[i]);
+            }
+        delete [] textStamp;
         }
-    CountRealUnMatched();
+    CountRealUnMatched(R);
     return result;
     }
 
-static void MarkRepeatedPhrases() // Cosmetic addition: phrases that occur
+static void MarkRepeatedPhrases(ranking * R) // Cosmetic addition: phrases that occur
                            // only once are not marked.
                            // Must be called after
                            // CountRepetitionsBetter(), where the real
                            // number of repetitions is computed.
     {
     unsigned long i;
-    for(i = 0;words1 + i <= lastword;++i)
-        words1[i].marked = _f_;
-    if(phrases && words1)
+    memset(R->marked,_f_,context->afterlastword - context->words1);
+    if(R->phrases && context->words1)
         {
         for ( i = 0
-            ; i < numberOfPhrases
+            ; i < R->numberOfPhrases
             ; ++i
             )
-            if(phrases[i]->RealCount() > 1)
-                phrases[i]->countPhrase(words1,false);
+            if(R->phrases[i]->RealCount() > 1)
+                R->phrases[i]->countPhrase(R,false);
         }
-    CountRealUnMatched();
+    CountRealUnMatched(R);
     }
 
 //#ifdef __BORLANDC__
-static void DrawGraph()
+static void DrawGraph(ranking * R)
     {
+    phrase ** phrases = R->phrases;
     unsigned long phraseno = 1;
 #ifdef __BORLANDC__
     clear();
@@ -1322,7 +1840,7 @@ static void DrawGraph()
     leastSquareFitter * line = new leastSquareFitter();
     unsigned long p;
     for ( p = 0
-        ; p < numberOfPhrases
+        ; p < R->numberOfPhrases
         ; ++p
         )
         {
@@ -1331,16 +1849,16 @@ static void DrawGraph()
             ++phraseno;
             }
         }
-    if(numberOfPhrases > 1)
+    if(R->numberOfPhrases > 1)
         {
-        b = line->b();
+        R->b = line->b();
 #ifdef __BORLANDC__
-        addXY(0.0,b,1);
+        addXY(0.0,R->b,1);
 #endif
-        m = line->m();
+        R->m = line->m();
 #ifdef __BORLANDC__
-        if(m != 0.0)
-            addXY((2.0-b)/m,2.0,1);
+        if(R->m != 0.0)
+            addXY((2.0-R->b)/R->m,2.0,1);
         else
             addXY(1.0,2.0,1); // exceptional: e.g. all phrases have same count.
 #endif
@@ -1350,7 +1868,7 @@ static void DrawGraph()
     if(phrases)
         {
         size_t LengthOfWorsePhrases = 0L;
-        for ( p = numberOfPhrases
+        for ( p = R->numberOfPhrases
             ; p != 0
             ;
             )
@@ -1363,10 +1881,10 @@ static void DrawGraph()
                 LengthOfWorsePhrases += phrases[p]->Length()*rc;
                 }
             }
-        fiducialTextLength = LengthOfWorsePhrases + realUnmatched;
-        size_t reducedTextLength = realUnmatched;
+        R->fiducialTextLength = LengthOfWorsePhrases + R->realUnmatched;
+        size_t reducedTextLength = R->realUnmatched;
         for ( p = 0
-            ; p < numberOfPhrases
+            ; p < R->numberOfPhrases
             ; ++p
             )
             {
@@ -1377,7 +1895,7 @@ static void DrawGraph()
                 //           LengthOfWorsePhrases = phrases[p]->getLengthOfWorsePhrases();
                 phrases[p]->setAccumulatedRepetitiveness
                     (
-                    (double)(afterlastword - words1 - numberOfSentenceSeparators)
+                    (double)(context->afterlastword - context->words1 - context->numberOfSentenceSeparators)
                     /
                     (double)(reducedTextLength + phrases[p]->getLengthOfWorsePhrases())
                     );
@@ -1390,32 +1908,32 @@ static void DrawGraph()
 #ifdef TEST
 static void WriteResults()
 {
-    if(typeArray && words1 && pwordlist)
+    if(context->typeArray && context->words1 && context->postingData)
         {
         FILE * fp = fopen("\\wordindex.txt","wb");
         if(fp)
             {
             unsigned long i;
             for ( i = 0
-                ; i < types
+                ; i < context->types
                 ; ++i
                 )
-                typeArray[i].print(fp);
+                context->typeArray[context->nameOrder[i]].print(fp);
             fclose(fp);
             }
         }
-    if(phrases)
+    if(context->rankings)
         {
         FILE * fp = fopen("\\phrases.txt","wb");
         if(fp)
             {
             for ( unsigned long p = 0
-                ; p < numberOfPhrases
+                ; p < context->rankings[context->shownRanking].numberOfPhrases
                 ; ++p
                 )
                 {
                 fprintf(fp,"%ld:",p);
-                phrases[p]->print(fp);
+                context->rankings[context->shownRanking].phrases[p]->print(fp);
                 }
             fclose(fp);
             }
@@ -1423,355 +1941,942 @@ static void WriteResults()
 }
 #endif
 
-static double RepetitivenessBetter()
+static double RepetitivenessBetter(ranking * R)
 {
     unsigned long i;
+    phrase ** phrases = R->phrases;
     if(phrases)
         {
-        reducedTextLength = fiducialTextLength = realUnmatched;
+        R->reducedTextLength = R->fiducialTextLength = R->realUnmatched;
         for ( i = 0
-            ; i < numberOfPhrases
+            ; i < R->numberOfPhrases
             ; ++i
             )
             {
             size_t rc = phrases[i]->RealCount();
             if(rc > 0L)
                 {
-                fiducialTextLength += phrases[i]->Length()*rc;
-                reducedTextLength += phrases[i]->Length();
+                R->fiducialTextLength += phrases[i]->Length()*rc;
+                R->reducedTextLength += phrases[i]->Length();
                 }
             }
         }
-    if(reducedTextLength > 0.0)
-        return (double)fiducialTextLength /(double)reducedTextLength;
+    if(R->reducedTextLength > 0.0)
+        return (double)R->fiducialTextLength /(double)R->reducedTextLength;
     else
         return 1.0;
 }
 
-static double ReductionDueToPreviousVersion(int fileno)
+static double ReductionDueToPreviousVersion(ranking * R,int fileno)
 {
-    filedata * pfile = filedatalist + fileno;
+    filedata * pfile = context->filedatalist + fileno;
     ptrdiff_t alltokens = ((pfile + 1)->boundary - pfile->boundary) - pfile->numberOfSentenceSeparators;
     if(alltokens > 0)
-        return ((double)(alltokens - pfile->realUnmatched))
+        return ((double)(alltokens - R->realUnmatchedFile[fileno]))
                 / ((double)alltokens);
     else
         return 0.0;
 }
 
-static void setWeightAsFrequency()
+double LogFac(unsigned long realCount)
     {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
-        {
-        typeArray[i].setWeightAsFrequency();
-        }
+    if(realCount < sizeof(logfac)/sizeof(logfac[0]))
+        return logfac[realCount];
+    else
+        return lgamma((double)realCount + 1.0);
     }
 
-static void setWeightAsLength()
+static double StirlingRemainder(double x)
+    /* log x! - (x log x - x + log(2 pi x)/2), good to 1e-12 for x >= 10 */
     {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
-        {
-        typeArray[i].setWeightAsLength();
-        }
+    double r = 1.0/x;
+    double rr = r*r;
+    return r*(1.0/12.0 - rr*(1.0/360.0 - rr*(1.0/1260.0 - rr/1680.0)));
     }
 
-static void setWeightAsFrequencyTimesLength()
+static double LogFallingFactorial(double x,double logx,unsigned long m)
+    /*
+     m-1
+     SUM log(x - j) = log x! - log (x - m)!      (x >= m, logx = log x)
+     j=0
+    Written so that the large terms of log x! and log (x - m)! cancel
+    analytically instead of numerically.
+    */
     {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
-        {
-        typeArray[i].setWeightAsFrequencyTimesLength();
-        }
+    double y = x - (double)m;
+    if(y < 10.0)
+        return lgamma(x + 1.0) - lgamma(y + 1.0);
+    return m * logx
+         - (y + 0.5) * log1p(-(double)m / x)
+         - (double)m
+         + StirlingRemainder(x) - StirlingRemainder(y);
     }
 
-static void setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency()
+#define DIRECTSUMMATION 8
+
+static double SumLogOfFreePositions(unsigned long realCount,size_t length)
+    /*
+     m
+    SUM log(n-jl+1)
+    j=1
+    */
     {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+    double sum = 0.0;
+    if(realCount <= DIRECTSUMMATION || realCount * length > context->tokens)
+        {
+        unsigned long j;
+        for ( j = 1
+            ; j <= realCount
+            ; ++j
+            )
+            {
+            if(context->tokens - j*length + 1 > 0)
+                {
+                sum += log((double)(context->tokens - j*length + 1));
+                }
+            }
+        }
+    else
         {
-        typeArray[i].setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
+        /* n-jl+1 = l(x - (j-1)) with x = (n+1)/l - 1 */
+        double x = (double)(context->tokens + 1 - length) / (double)length;
+        sum = realCount * log((double)length)
+            + LogFallingFactorial(x,log(x),realCount);
         }
+    return sum;
     }
 
-static void setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency()
+/*
+Weight functions.
+
+Each weight function is a type with a static member weight() that computes
+the weight of one phrase. weighPhrases<W> applies W to all phrases, so the
+choice of formula is made once, when setWeight is assigned, and the formula
+itself is inlined in the loop over the phrases.
+*/
+
+struct weightAsFrequency
     {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+    static double weight(const phrase * Phrase)
         {
-        typeArray[i].setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency();
+        return Phrase->Count();
         }
-    }
+    };
 
-static void setWeightAsFrequencyTimesLengthTimesAverageOfEntropy()
+struct weightAsLength
     {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+    static double weight(const phrase * Phrase)
         {
-        typeArray[i].setWeightAsFrequencyTimesLengthTimesAverageOfEntropy();
+        return Phrase->Length();
         }
-    }
+    };
 
-static void setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength()
+struct weightAsFrequencyTimesLength
     {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+    static double weight(const phrase * Phrase)
         {
-        typeArray[i].setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength();
+        return Phrase->Length() * Phrase->Count();
         }
-    }
+    };
 
-/*static void setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction()
-    {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+struct weightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency
+    { // Phrase Frequency * SUM("wavelength"), where wavelength=average distance between occurrences of word=inverse of frequency
+    static double weight(const phrase * Phrase)
         {
-        typeArray[i].setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction();
+        const word * wording = Phrase->Wording();
+        size_t length = Phrase->Length();
+        double av = 0.0;
+        for(size_t i = 0;i < length;++i)
+            av += context->typeStats[wording[i].tp - context->typeArray].inverseFrequency;
+        return av * Phrase->Count();
         }
-    }
-*/
-static void setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction()
-    {
-    unsigned long i;
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+    };
+
+struct weightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency
+    { // Phrase Frequency * phrase length * PRODUCT("wavelength"/meanwavelength), where wavelength=average distance between occurrences of word=inverse of frequency
+    static double weight(const phrase * Phrase)
         {
-        typeArray[i].setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction();
+        const word * wording = Phrase->Wording();
+        size_t length = Phrase->Length();
+        double prod = 1.0;
+        for(size_t i = 0;i < length;++i)
+            prod *= context->typeStats[wording[i].tp - context->typeArray].ratio;
+        return prod * Phrase->Count() * length;
         }
-    }
+    };
 
-static void setWeight2005()
+struct weightAsFrequencyTimesLengthTimesAverageOfEntropy
     {
-    unsigned long i;
-    logfac[0] = 0; // log 0!
-    for(i = 1;i < sizeof(logfac)/sizeof(logfac[0]);++i)
-        logfac[i] = logfac[i-1] + log(double(i));
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+    static double weight(const phrase * Phrase)
         {
-        typeArray[i].setWeight2005();
+        const word * wording = Phrase->Wording();
+        size_t length = Phrase->Length();
+        double av = 0.0;
+        for(size_t i = 0;i < length;++i)
+            av += context->typeStats[wording[i].tp - context->typeArray].entropy;
+        return av * Phrase->Count();
         }
-    }
+    };
 
-static void setWeight2005b()
+struct weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength
     {
-    unsigned long i;
-    logfac[0] = 0; // log 0!
-    for(i = 1;i < sizeof(logfac)/sizeof(logfac[0]);++i)
-        logfac[i] = logfac[i-1] + log(double(i));
-    for ( i = 0
-        ; i < types
-        ; ++i
-        )
+    static double weight(const phrase * Phrase)
         {
-        typeArray[i].setWeight2005b();
+        return weightAsFrequencyTimesLengthTimesAverageOfEntropy::weight(Phrase)
+             * log((double)Phrase->Length());
         }
-    }
-
-static void (*setWeight)(void) = //setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency;
-                            //setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency;
-                            setWeight2005;
+    };
 
-bool weightIsFrequency()
+struct weightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction
     {
-    return setWeight == setWeightAsFrequency;
-    }
+    static double weight(const phrase * Phrase)
+        {
+        const word * wording = Phrase->Wording();
+        size_t length = Phrase->Length();
+        double av = 0.0;
+        for(size_t i = 0;i < length;++i)
+            av += context->typeStats[wording[i].tp - context->typeArray].inverseFrequency;
+        return av * Phrase->RealCount(); // count * (realCount/count) = realCount
+        }
+    };
 
-bool weightIsLength()
+struct weight2005
     {
-    return setWeight == setWeightAsLength;
-    }
+/*
+x  = type
+ i
 
-bool weightIsFrequencyTimesLength()
-    {
-    return setWeight == setWeightAsFrequencyTimesLength;
-    }
+n = number of words in text
+m = number of repetitions of phrase
 
-bool weightIsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency()
-    {
-    return setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency;
-    }
+x ... x  = a sequence of l types x ... x  ('phrase')
+ 1     l                          1     l
+               l
+p(x ...x ) = PROD p(x )
+   1    l     i=1    i
 
-bool weightIsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency()
-    {
-    return setWeight == setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency;
+ m
+P (x ...x ) = Probability that phrase x ...x  occurs m times in a text with length n
+ n  1    l                             1    l
+                m
+              PROD (n - jl + 1)
+              j=1                            m                  n - ml
+            = ----------------- (p(x ... x ))  (1 - p(x ... x ))
+                     m!             1     l            1     l
+
+
+       m                         m
+  log P (x ... x ) = - log m! + SUM log(n-jl+1) + m log p(x ...x ) + (n - ml) log (1 - p(x ...x ))
+       n  1     l               j=1                        1    l                         1    l
+
+*/
+    static double weight(const phrase * Phrase)
+        {
+        const word * wording = Phrase->Wording();
+        size_t length = Phrase->Length();
+        unsigned long realCount = Phrase->RealCount();
+        double Sum = 0.0;
+/*
+    -log m!
+*/
+        Sum -= LogFac(realCount);
+/*
+     m
+    SUM log(n-jl+1)
+    j=1
+*/
+        Sum += SumLogOfFreePositions(realCount,length);
+/*
+    m log p(x ... x )
+             1     l
+and
+(n - ml) log (1 - p(x ...x ))
+                     1    l
+*/
+        double sum = 0.0;
+        double prod = 1.0;
+        for(size_t i = 0;i < length;++i)
+            {
+            const typestat & stat = context->typeStats[wording[i].tp - context->typeArray];
+            sum += stat.logFrequency;
+            prod *= stat.probability;
+            }
+        if(context->tokens > 0)
+            {
+            Sum += realCount * (sum - length * context->logTokens);
+            }
+        if(prod < 1.0)
+            {
+            Sum += (context->tokens - realCount*length)*log1p(-prod);
+            }
+        return -Sum;
+        }
+    };
+
+// This weight function decrements a word's frequency each time the word occurs
+// in a sequence. The probability that a sequence occurs more often than any
+// of its words thereby becomes zero. In the previous weight function the word
+// probabilities are fixed and there is a non-zero probability that a sequence
+// occurs more often than any of its words.
+// There are some differences in the order of the phrases, but they are not that
+// big.
+struct weight2005b
+    {
+/*
+      m          m   l
+     SUM log(n-jl+1) + SUM SUM log(f(x ) - j + 1) - lm log n - log m!
+     j=1              i=1 j=1        i
+
+The second sum is a falling factorial per word, which is evaluated in closed
+form. (A term (n - jl) log(1 - p ) used to be added for each j, but p  was
+                                j                                    j
+truncated to zero by integer division, so it never contributed.)
+*/
+    static double weight(const phrase * Phrase)
+        {
+        const word * wording = Phrase->Wording();
+        size_t length = Phrase->Length();
+        unsigned long realCount = Phrase->RealCount();
+        double Sum = SumLogOfFreePositions(realCount,length);
+        for(size_t i = 0;i < length;++i)
+            {
+            unsigned long frequency = wording[i].tp->getFrequency();
+            unsigned long m = realCount < frequency ? realCount : frequency;
+            if(m <= DIRECTSUMMATION)
+                {
+                for(unsigned long j = 0;j < m;++j)
+                    Sum += log((double)(frequency - j));
+                }
+            else
+                Sum += LogFallingFactorial((double)frequency,context->typeStats[wording[i].tp - context->typeArray].logFrequency,m);
+            }
+        Sum -= length * realCount * context->logTokens;
+        Sum -= LogFac(realCount);
+        return -Sum;
+        }
+    };
+
+/* The key on which SortPhrases sorts: the weight, transformed by weightKey,
+and the position of the phrase in phrases[] before sorting. */
+typedef struct phrasekey
+    {
+    unsigned long long key;
+    unsigned long index;
+    } phrasekey;
+
+/* Maps weights to unsigned integers in reverse order: the higher the weight,
+the lower the key. */
+static unsigned long long weightKey(double weight)
+    {
+    const unsigned long long sign = 0x8000000000000000ULL;
+    unsigned long long bits;
+    if(weight != weight)
+        return ~0ULL; // NaN last
+    if(weight == 0.0)
+        weight = 0.0; // -0.0 ties with 0.0
+    memcpy(&bits,&weight,sizeof(bits));
+    if(bits & sign)
+        return bits;
+    else
+        return ~bits & ~sign;
+    }
+
+template <class W> static void weighPhrases(ranking * R,phrasekey * keys)
+    {
+    phrase ** phrases = R->phrases;
+    parallelForAnalysis(R->numberOfPhrases,PHRASESPERTHREAD,[phrases,keys](unsigned long first,unsigned long last)
+        {
+        for(unsigned long p = first;p < last;++p)
+            {
+            double weight = W::weight(phrases[p]);
+            phrases[p]->setWeight(weight);
+            if(keys)
+                {
+                keys[p].key = weightKey(weight);
+                keys[p].index = p;
+                }
+            }
+        });
+    }
+
+
+typedef struct weightrec
+    {
+    const char * n; // -w <n>
+    const char * w; // -w <w>
+    const char * description;
+    void (*f)(ranking * R,phrasekey * keys);
+    } weightrec;
+
+static weightrec weightrecs[]=
+    {
+        {"1","F","phrase frequency",weighPhrases<weightAsFrequency>},
+        {"2","L","phrase length",weighPhrases<weightAsLength>},
+        {"3","FL","phrase frequency * phrase length",weighPhrases<weightAsFrequencyTimesLength>},
+        {"4","FL/wf","phrase frequency * phrase length * average of inverse of word frequency",weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency>},
+        {"5","FLR","phrase frequency * phrase length * ratios (average word frequency / real word frequency)",weighPhrases<weightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency>},
+        {"6","FLE","phrase frequency * phrase length * average of word entropy",weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropy>},
+        {"7","FLElogL","phrase frequency * phrase length * average of word entropy * log(phrase length)",weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength>},
+        //{"","","phrase frequency * phrase length * average of word entropy * log(phrase length) * Phrase count reduction factor",weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction>},
+        {"8","FL/wfP","phrase frequency * phrase length * average of inverse of word frequency * Phrase count reduction factor",weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction>},
+        {"9","2005","2005",weighPhrases<weight2005>},
+        {"10","2005b","2005b",weighPhrases<weight2005b>},
+        {0,0,0,0}
+    };
+
+static_assert(sizeof(weightrecs)/sizeof(weightrecs[0]) - 1 == NUMBEROFWEIGHTS,"NUMBEROFWEIGHTS");
+
+analysis::analysis()
+    {
+    versioncomparison = false;
+    npasses = 1;
+    topK = 0L;
+    maxlimit = -1;
+    minlimit = 2;
+#if DOUNICODE && !UNICODE_CAPABLE
+    case_sensitive = true;
+#else
+    case_sensitive = false;
+#endif
+    markedOutput = NULL;
+    writeMarkedTexts = true;
+    markedCompression = noCompression;
+    pagePrefix = NULL;
+    pageIndex = NULL;
+    rowsPerPage = 1000;
+    memset(character,0,sizeof(character));
+    memset(replacement_for_string_constituent,0,sizeof(replacement_for_string_constituent));
+    Fuzzyness = fuzzynessLevel(0);
+    numberOfRequestedLevels = 0;
+    setWeight = weighPhrases<weight2005>;
+    numberOfRequestedWeights = 0;
+
+    lowestfreq = ULONG_MAX;
+    highestfreq = 0L;
+    tokens = gtokens = 0L;
+    types = 0L;
+    lowtype = hightype = 0L;
+    numberOfSentenceSeparators = 0L;
+    averageTypeFrequency = 0.0;
+    logTokens = 0.0;
+    UTF8 = true;
+    morphemes = false;
+    mappedFiles = NULL;
+    textBuffer = NULL;
+    vocabulary = NULL;
+    words1 = lastword = afterlastword = NULL;
+    filedatalist = NULL;
+    numberOfFiles = 0;
+    typeArray = NULL;
+    nameOrder = NULL;
+    typeStats = NULL;
+    postingData = NULL;
+    tokenIds = NULL;
+    memset(discoveries,0,sizeof(discoveries));
+    numberOfDiscoveries = 0;
+    rankings = NULL;
+    numberOfRankings = 0;
+    numberOfRankedLevels = 0;
+    shownRanking = 0;
+    inpos = 0L;
+    numberOfBytes = 0L;
+    ptextBuffer = NULL;
+    theBigIndex = NULL;
+    pindex = NULL;
+    inside = nowhere;
+    }
+
+analysis::~analysis()
+    {
+    unmapFiles();
+    }
+
+void analysis::unmapFiles()
+    {
+    for(mappedFile * M = mappedFiles;M;M = M->next)
+        munmap(M->address,M->length);
+    mappedFiles = NULL;
+    }
+
+analysis * NewAnalysis()
+    {
+    analysis * A = new analysis;
+    static_cast<analysisSettings &>(*A) = *context;
+    return A;
+    }
+
+void DeleteAnalysis(analysis * A)
+    {
+    if(A == context)
+        context = &defaultAnalysis;
+    if(A != &defaultAnalysis)
+        delete A;
+    }
+
+void CopySettings(analysis * to,const analysis * from)
+    {
+    static_cast<analysisSettings &>(to ? *to : defaultAnalysis) = from ? *from : defaultAnalysis;
+    }
+
+analysis * UseAnalysis(analysis * A)
+    {
+    analysis * previous = context == &defaultAnalysis ? NULL : context;
+    context = A ? A : &defaultAnalysis;
+    return previous;
+    }
+
+static const char * weightDescription(void (*f)(ranking * R,phrasekey * keys))
+    {
+    for(int i = 0;weightrecs[i].n;++i)
+        if(weightrecs[i].f == f)
+            return weightrecs[i].description;
+    return "";
+    }
+
+int chooseWeights(const char * list)
+    {
+    int n = 0;
+    bool all = !strcmp(list,"all");
+    while(*list)
+        {
+        size_t len = all ? 0 : strcspn(list,",");
+        for(int i = 0;weightrecs[i].n;++i)
+            {
+            if(  all
+              || (strlen(weightrecs[i].n) == len && !strncmp(weightrecs[i].n,list,len))
+              || (strlen(weightrecs[i].w) == len && !strncmp(weightrecs[i].w,list,len))
+              )
+                {
+                int j;
+                for(j = 0;j < n && context->requestedWeights[j] != weightrecs[i].f;++j)
+                    ;
+                if(j == n)
+                    context->requestedWeights[n++] = weightrecs[i].f;
+                if(!all)
+                    break;
+                }
+            }
+        list += all ? strlen(list) : len;
+        if(*list == ',')
+            ++list;
+        }
+    if(n == 1)
+        {
+        context->setWeight = context->requestedWeights[0];
+        context->numberOfRequestedWeights = 0;
+        }
+    else if(n > 1)
+        context->numberOfRequestedWeights = n;
+    return n;
+    }
+
+int GetNumberOfRankings()
+    {
+    return context->numberOfRankings;
+    }
+
+void selectRanking(int i)
+    {
+    if(0 <= i && i < context->numberOfRankings)
+        context->shownRanking = i;
+    }
+
+bool weightIsFrequency()
+    {
+    return context->setWeight == weighPhrases<weightAsFrequency>;
+    }
+
+bool weightIsLength()
+    {
+    return context->setWeight == weighPhrases<weightAsLength>;
+    }
+
+bool weightIsFrequencyTimesLength()
+    {
+    return context->setWeight == weighPhrases<weightAsFrequencyTimesLength>;
+    }
+
+bool weightIsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency()
+    {
+    return context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency>;
+    }
+
+bool weightIsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency()
+    {
+    return context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency>;
     }
 
 bool weightIsFrequencyTimesLengthTimesAverageOfEntropy()
     {
-    return setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropy;
+    return context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropy>;
     }
 
 bool weightIsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength()
     {
-    return setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength;
+    return context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength>;
     }
 
 /*bool weightIsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction()
     {
-    return setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction;
+    return setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction>;
     }
 */
 bool weightIsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction()
     {
-    return setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction;
+    return context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction>;
     }
 
 bool weightIs2005()
     {
-    return setWeight == setWeight2005;
+    return context->setWeight == weighPhrases<weight2005>;
     }
 
 bool weightIs2005b()
     {
-    return setWeight == setWeight2005b;
+    return context->setWeight == weighPhrases<weight2005b>;
+    }
+
+void setRecursion(int passes)
+    {
+    context->npasses = passes;
+    }
+
+void setTopK(unsigned long K)
+    {
+    context->topK = K;
+    }
+
+bool repetitivenessIsApproximate()
+    {
+    return context->rankings && context->rankings[context->shownRanking].approximate;
+    }
+
+void setVersionComparison(bool flag)
+    {
+    context->versioncomparison = flag;
+    }
+
+void setCaseSensitive(bool flag)
+    {
+    context->case_sensitive = flag;
+    }
+
+void setMarkedOutput(const char * name)
+    {
+    context->markedOutput = name;
+    }
+
+void setWriteMarkedTexts(bool flag)
+    {
+    context->writeMarkedTexts = flag;
     }
 
-void setRecursion(int npasses)
+void setPhrasePages(const char * prefix,unsigned long rowsPerPage,const char * index)
     {
-    ::npasses = npasses;
+    context->pagePrefix = prefix;
+    context->pageIndex = index;
+    context->rowsPerPage = rowsPerPage > 0 ? rowsPerPage : 1000;
+    }
+
+bool setCompression(const char * method)
+    {
+    if(!method)
+        {
+        context->markedCompression = noCompression;
+        return true;
+        }
+    return parseCompression(method,context->markedCompression);
     }
 
 void setUnlimited(bool flag,int editMaxLimit)
     {
     if(flag)
-        ::maxlimit = -1;
+        context->maxlimit = -1;
     else
-        ::maxlimit = editMaxLimit;
+        context->maxlimit = editMaxLimit;
     }
 
 void setMaxLimit(int limit)
     {
-    ::maxlimit = limit;
+    context->maxlimit = limit;
     }
 
 void setMinLimit(int limit)
     {
-    ::minlimit = limit;
+    context->minlimit = limit;
     }
 
 void chooseWeightAsFrequency()
     {
-    setWeight = setWeightAsFrequency;
+    context->setWeight = weighPhrases<weightAsFrequency>;
     }
 
 void chooseWeightAsLength()
     {
-    setWeight = setWeightAsLength;
+    context->setWeight = weighPhrases<weightAsLength>;
     }
 
 void chooseWeightAsFrequencyTimesLength()
     {
-    setWeight = setWeightAsFrequencyTimesLength;
+    context->setWeight = weighPhrases<weightAsFrequencyTimesLength>;
     }
 
 void chooseWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency()
     {
-    setWeight = setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency;
+    context->setWeight = weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency>;
     }
 
 void chooseWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency()
     {
-    setWeight = setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency;
+    context->setWeight = weighPhrases<weightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency>;
     }
 
 void chooseWeightAsFrequencyTimesLengthTimesAverageOfEntropy()
     {
-    setWeight = setWeightAsFrequencyTimesLengthTimesAverageOfEntropy;
+    context->setWeight = weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropy>;
     }
 
 void chooseWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength()
     {
-    setWeight = setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength;
+    context->setWeight = weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength>;
     }
 
 /*void chooseWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction()
     {
-    setWeight = setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction;
+    setWeight = weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction>;
     }
 */
 void chooseWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction()
     {
-    setWeight = setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction;
+    context->setWeight = weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction>;
     }
 
 void chooseWeightAs2005()
     {
-    setWeight = setWeight2005;
+    context->setWeight = weighPhrases<weight2005>;
     }
 
 void chooseWeightAs2005b()
     {
-    setWeight = setWeight2005b;
+    context->setWeight = weighPhrases<weight2005b>;
     }
 
-static int
-#ifdef __BORLANDC__
-    _USERENTRY
-#endif
-    phraseComp(const void *a, const void *b)
-    {
-    phrase ** A = (phrase **)a;
-    phrase ** B = (phrase **)b;
-    if((*B)->Weight() > (*A)->Weight())
-        return 1;
-    if ((*B)->Weight() < (*A)->Weight())
-        return -1;
-    return 0;
+#define RADIXBITS 11
+#define RADIXBUCKETS (1 << RADIXBITS)
+#define KEYSPERSLICE 65536
+
+/* Stable LSD radix sort on phrasekey::key. The keys come in index order, so
+equal weights stay in the order of the previous pass. Each digit is counted
+and scattered in slices, in parallel. Digits that are the same for all keys
+are skipped. */
+static void radixSortPhraseKeys(phrasekey * keys,unsigned long n)
+    {
+    if(n < 2)
+        return;
+    unsigned long nslices = numberOfThreads();
+    if(nslices > n / KEYSPERSLICE)
+        nslices = n / KEYSPERSLICE;
+    if(nslices < 1)
+        nslices = 1;
+    const unsigned long slice = (n + nslices - 1) / nslices;
+    unsigned long * counts = new unsigned long[nslices * RADIXBUCKETS];
+    phrasekey * buffer = new phrasekey[n];
+    phrasekey * from = keys;
+    phrasekey * to = buffer;
+    for(int shift = 0;shift < 64;shift += RADIXBITS)
+        {
+        parallelForAnalysis(nslices,1,[=](unsigned long first,unsigned long last)
+            {
+            for(unsigned long s = first;s < last;++s)
+                {
+                unsigned long * count = counts + s * RADIXBUCKETS;
+                unsigned long end = (s + 1) * slice < n ? (s + 1) * slice : n;
+                memset(count,0,RADIXBUCKETS * sizeof(count[0]));
+                for(unsigned long i = s * slice;i < end;++i)
+                    ++count[(from[i].key >> shift) & (RADIXBUCKETS - 1)];
+                }
+            });
+        unsigned long sum = 0;
+        bool allSame = false;
+        for(unsigned long d = 0;d < RADIXBUCKETS && !allSame;++d)
+            {
+            unsigned long start = sum;
+            for(unsigned long s = 0;s < nslices;++s)
+                {
+                unsigned long c = counts[s * RADIXBUCKETS + d];
+                counts[s * RADIXBUCKETS + d] = sum;
+                sum += c;
+                }
+            allSame = sum - start == n;
+            }
+        if(allSame)
+            continue;
+        parallelForAnalysis(nslices,1,[=](unsigned long first,unsigned long last)
+            {
+            for(unsigned long s = first;s < last;++s)
+                {
+                unsigned long * next = counts + s * RADIXBUCKETS;
+                unsigned long end = (s + 1) * slice < n ? (s + 1) * slice : n;
+                for(unsigned long i = s * slice;i < end;++i)
+                    to[next[(from[i].key >> shift) & (RADIXBUCKETS - 1)]++] = from[i];
+                }
+            });
+        phrasekey * tmp = from;
+        from = to;
+        to = tmp;
+        }
+    if(from != keys)
+        memcpy(keys,from,n * sizeof(keys[0]));
+    delete [] buffer;
+    delete [] counts;
     }
 
-static void SortPhrases()
+static void SortPhrases(ranking * R,phrasekey * keys)
     {
-    if(phrases)
-        {
-        qsort(phrases,numberOfPhrases,sizeof(phrases[0]),phraseComp);
-        if(versioncomparison)
-            CountRepetitionsInTextsBetter();
+    if(R->phrases)
+        {
+        radixSortPhraseKeys(keys,R->numberOfPhrases);
+        phrase ** sorted = new phrase * [R->numberOfPhrases];
+        for(unsigned long p = 0;p < R->numberOfPhrases;++p)
+            sorted[p] = R->phrases[keys[p].index];
+        memcpy(R->phrases,sorted,R->numberOfPhrases * sizeof(sorted[0]));
+        delete [] sorted;
+        if(context->versioncomparison)
+            CountRepetitionsInTextsBetter(R);
+        else
+            CountRepetitionsBetter(R);
+        }
+    }
+
+static bool phraseKeyLess(const phrasekey & a,const phrasekey & b)
+    {
+    return a.key < b.key || (a.key == b.key && a.index < b.index);
+    }
+
+/* Replaces SortPhrases in the last pass in top-K mode. Selects, sorts and
+recounts phrases in batches of increasing size, from the highest weight down,
+until topK phrases are repeated. The order and the real counts of those phrases
+are the same as after SortPhrases. The remaining phrases are dropped from the
+ranking, so the repetitiveness is a lower bound. */
+static void SortTopPhrases(ranking * R,phrasekey * keys)
+    {
+    unsigned long n = R->numberOfPhrases;
+    unsigned long done = 0L;
+    unsigned long repeated = 0L;
+    unsigned long batch = context->topK;
+    phrase ** sorted = new phrase * [n];
+    unsigned long * textStamp = context->versioncomparison ? newTextStamps() : NULL;
+    int texts = context->versioncomparison ? textsToConfirm() : 0;
+    memset(R->marked,_f_,context->afterlastword - context->words1);
+    while(done < n && repeated < context->topK)
+        {
+        unsigned long end = batch < n - done ? done + batch : n;
+        if(end < n)
+            std::nth_element(keys + done,keys + end,keys + n,phraseKeyLess);
+        std::sort(keys + done,keys + end,phraseKeyLess);
+        for(;done < end && repeated < context->topK;++done)
+            {
+            phrase * Phrase = R->phrases[keys[done].index];
+            sorted[done] = Phrase;
+            if(context->versioncomparison)
+                countPhraseInAllTexts(R,Phrase,textStamp,done + 1,texts);
+            else
+                Phrase->countPhrase(R,true);
+            rowIsFinal(R,Phrase);
+            if(Phrase->RealCount() > 1)
+                ++repeated;
+            }
+        batch *= 2;
+        }
+    delete [] textStamp;
+    memcpy(R->phrases,sorted,done * sizeof(sorted[0]));
+    delete [] sorted;
+    R->approximate = done < n;
+    R->numberOfPhrases = done;
+    CountRealUnMatched(R);
+    }
+
+static void RankPhrases(ranking * R)
+    {
+    phrasekey * keys = new phrasekey[R->numberOfPhrases];
+    for(int i = 0; i < context->npasses; ++i)
+        {
+        R->setWeight(R,keys);
+        if(context->pagePrefix && i == context->npasses - 1)
+            R->pages = new pageWriter((int)(R - context->rankings) + 1);
+        if(context->topK > 0 && i == context->npasses - 1)
+            SortTopPhrases(R,keys); // earlier passes set the weights of all phrases
         else
-            CountRepetitionsBetter();
+            SortPhrases(R,keys);
+        }
+    delete [] keys;
+    R->repetitiveness = RepetitivenessBetter(R);
+    for(int fileno = 0;fileno < context->numberOfFiles;fileno++)
+        R->alikeness[fileno] = ReductionDueToPreviousVersion(R,fileno);
+    MarkRepeatedPhrases(R);
+//#ifdef __BORLANDC__
+    DrawGraph(R);
+//#endif
+    if(R->pages)
+        {
+        R->pages->finish(R);
+        delete R->pages;
+        R->pages = NULL;
         }
     }
 
 char ** WriteTextWithMarkings()
     {
     char ** markedfiles;
+    if(!context->rankings)
+        return NULL;
     //markedfile = writePhraseRTF(words1,lastword);
-    markedfiles = writePhraseHTML(words1,lastword);
+    const char * marked = context->rankings[context->shownRanking].marked;
+    if(context->markedOutput)
+        {
+        FILE * fpo = compressingStream(fopen(context->markedOutput,"wb"),context->markedCompression);
+        if(!fpo)
+            return NULL;
+        bool written = writeCombinedHTML(marked,fpo);
+        if(fclose(fpo) != 0 || !written)
+            return NULL;
+        markedfiles = new char * [2];
+        markedfiles[0] = new char[strlen(context->markedOutput) + 1];
+        strcpy(markedfiles[0],context->markedOutput);
+        markedfiles[1] = NULL;
+        }
+    else
+        markedfiles = writePhraseHTML(marked);
 #ifdef TEST
     WriteResults();
 #endif
     return markedfiles;
     }
 
+bool WriteTextWithMarkings(int fileno,FILE * fp)
+    {
+    if(!context->rankings || fileno < 0 || fileno >= context->numberOfFiles)
+        return false;
+    return writeMarkedHTML(context->rankings[context->shownRanking].marked,context->filedatalist + fileno,fp);
+    }
+
+bool WriteTextWithMarkings(FILE * fp)
+    {
+    if(!context->rankings || !context->filedatalist)
+        return false;
+    return writeCombinedHTML(context->rankings[context->shownRanking].marked,fp);
+    }
+
+void DeleteMarkedFileNames(char ** names)
+    {
+    if(names)
+        {
+        for(char ** name = names;*name;++name)
+            delete [] *name;
+        delete [] names;
+        }
+    }
+
 #if 0
 char * WritePhrases()
     {
@@ -1782,9 +2887,9 @@ char * WritePhrases()
         FILE * fp = fopen(phrasesfile/*"marked.txt"*/,"wb");
         if(fp)
             {
-            fprintf(fp,"task: %s\n",versioncomparison ? "version comparison" : "repetitiveness checking");
+            fprintf(fp,"task: %s\n",context->versioncomparison ? "version comparison" : "repetitiveness checking");
 
-            fprintf(fp,"case sensitive: %s\n",case_sensitive ? "yes" : "no");
+            fprintf(fp,"case sensitive: %s\n",context->case_sensitive ? "yes" : "no");
 
             fprintf(fp,"fuzzy match level: ");
             switch(currentFuzzynessBoundary())
@@ -1811,37 +2916,37 @@ char * WritePhrases()
                     fprintf(fp,"%d",currentFuzzynessBoundary());
                 }
             fprintf(fp,"\n");
-            if(maxlimit >= minlimit)
+            if(context->maxlimit >= context->minlimit)
                 {
-                fprintf(fp,"words/phrase: %d - %d\n",minlimit,maxlimit);
+                fprintf(fp,"words/phrase: %d - %d\n",context->minlimit,context->maxlimit);
                 }
             else
                 {
-                fprintf(fp,"words/phrase: %d - unlimited\n",minlimit);
+                fprintf(fp,"words/phrase: %d - unlimited\n",context->minlimit);
                 }
-            fprintf(fp,"passes: %d\n",npasses);
+            fprintf(fp,"passes: %d\n",context->npasses);
 
-            if(setWeight == setWeightAsFrequency)
+            if(context->setWeight == weighPhrases<weightAsFrequency>)
                 fprintf(fp,"weight = phrase frequency\n\n");
-            else if(setWeight == setWeightAsLength)
+            else if(context->setWeight == weighPhrases<weightAsLength>)
                 fprintf(fp,"weight = phrase length\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLength)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLength>)
                 fprintf(fp,"weight = phrase frequency * phrase length\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of inverse of word frequency\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency>)
                 fprintf(fp,"weight = phrase frequency * phrase length * ratios (average word frequency / real word frequency)\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropy)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropy>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy * log(phrase length)\n\n");
-/*            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction)
+/*            else if(setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy * log(phrase length) * Phrase count reduction factor\n\n");*/
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of inverse of word frequency * Phrase count reduction factor\n\n");
-            else if(setWeight == setWeight2005)
+            else if(context->setWeight == weighPhrases<weight2005>)
                 fprintf(fp,"weight = 2005\n\n");
-            else if(setWeight == setWeight2005b)
+            else if(context->setWeight == weighPhrases<weight2005b>)
                 fprintf(fp,"weight = 2005b\n\n");
 
             fprintf(fp,"repetitiveness = %f\n\n",repetitiveness);
@@ -1873,10 +2978,10 @@ void WritePhrasesArg(bool morphemes,FILE * fp,flagspreambule preambule,bool b_ph
     if(phrases && fp)
         {
         if(preambule.bools.b_task)
-            fprintf(fp,"task: %s\n",versioncomparison ? "version comparison" : "repetitiveness checking");
+            fprintf(fp,"task: %s\n",context->versioncomparison ? "version comparison" : "repetitiveness checking");
 
         if(preambule.bools.b_case_sensitive)
-            fprintf(fp,"case sensitive: %s\n",case_sensitive ? "yes" : "no");
+            fprintf(fp,"case sensitive: %s\n",context->case_sensitive ? "yes" : "no");
 
         if(preambule.bools.b_fuzzy)
             {
@@ -1908,41 +3013,41 @@ void WritePhrasesArg(bool morphemes,FILE * fp,flagspreambule preambule,bool b_ph
             }
         if(preambule.bools.b_limit)
             {
-            if(maxlimit >= minlimit)
+            if(context->maxlimit >= context->minlimit)
                 {
-                fprintf(fp,"words/phrase: %d - %d\n",minlimit,maxlimit);
+                fprintf(fp,"words/phrase: %d - %d\n",context->minlimit,context->maxlimit);
                 }
             else
                 {
-                fprintf(fp,"words/phrase: %d - unlimited\n",minlimit);
+                fprintf(fp,"words/phrase: %d - unlimited\n",context->minlimit);
                 }
             }
         if(preambule.bools.b_passes)
-            fprintf(fp,"passes: %d\n",npasses);
+            fprintf(fp,"passes: %d\n",context->npasses);
 
         if(preambule.bools.b_weight)
             {
-            if(setWeight == setWeightAsFrequency)
+            if(context->setWeight == weighPhrases<weightAsFrequency>)
                 fprintf(fp,"weight = phrase frequency\n\n");
-            else if(setWeight == setWeightAsLength)
+            else if(context->setWeight == weighPhrases<weightAsLength>)
                 fprintf(fp,"weight = phrase length\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLength)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLength>)
                 fprintf(fp,"weight = phrase frequency * phrase length\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of inverse of word frequency\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency>)
                 fprintf(fp,"weight = phrase frequency * phrase length * ratios (average word frequency / real word frequency)\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropy)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropy>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy\n\n");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy * log(phrase length)\n\n");
-    /*            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction)
+    /*            else if(setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy * log(phrase length) * Phrase count reduction factor\n\n");*/
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction)
+            else if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction>)
                 fprintf(fp,"weight = phrase frequency * phrase length * average of inverse of word frequency * Phrase count reduction factor\n\n");
-            else if(setWeight == setWeight2005)
+            else if(context->setWeight == weighPhrases<weight2005>)
                 fprintf(fp,"weight = 2005\n\n");
-            else if(setWeight == setWeight2005b)
+            else if(context->setWeight == weighPhrases<weight2005b>)
                 fprintf(fp,"weight = 2005b\n\n");
             }
         if(preambule.bools.b_repetitiveness)
@@ -1990,152 +3095,518 @@ void WritePhrasesArg(bool morphemes,FILE * fp,flagspreambule preambule,bool b_ph
     }
 #endif
 
-void WritePhrasesArgHTML(char ** names,double * versionalikeness,bool morphemes,FILE * fp,flagspreambule preambule,bool b_phraseno,bool b_realCount,bool b_weight, bool b_getAccumulatedRepetitiveness)
+static void writeFuzzynessHTML(FILE * fp,int boundary)
     {
-    if(phrases && fp)
+    fprintf(fp,"<p>fuzzy match level: ");
+    switch(boundary)
         {
-        header(fp,"phrases");
-        if(preambule.bools.b_task)
-            {
-            fprintf(fp,"<p>task: %s</p>\n",versioncomparison ? "version comparison" : "repetitiveness checking");
-            }
-        if(names[1])
-            {
-            fprintf(fp,"<p>alikeness:</p>\n");
-            while(*names)
-                {
-                fprintf(fp,"<p>%s: %f</p>\n",*names,*versionalikeness);
-                ++names;
-                ++versionalikeness;
-                }
-            }
+        case 100:
+            fprintf(fp,"sentence");
+            break;
+        case 95:
+            fprintf(fp,"95%%");
+            break;
+        case 85:
+            fprintf(fp,"85%%");
+            break;
+        case 75:
+            fprintf(fp,"75%%");
+            break;
+        case 50:
+            fprintf(fp,"50%%");
+            break;
+        case 0:
+            fprintf(fp,"no limit");
+            break;
+        default:
+            fprintf(fp,"%d",boundary);
+        }
+    fprintf(fp,"</p>\n");
+    }
 
-        if(preambule.bools.b_case_sensitive)
-            {
-            fprintf(fp,"<p>case sensitive: %s</p>\n",case_sensitive ? "yes" : "no");
-            }
+static void writeTableHead(FILE * fp,bool b_phraseno,bool b_realCount,bool b_weight, bool b_getAccumulatedRepetitiveness)
+    {
+    fprintf(fp,"<table><colgroup>");
+    if(b_phraseno)
+        fprintf(fp,"<col align=\"right\" />");
+    if(b_realCount)
+        fprintf(fp,"<col align=\"right\" />");
+    if(b_weight)
+        //fprintf(fp,"<col align=\"char\" char=\".\" />");
+        fprintf(fp,"<col align=\"right\" />");
+    if(b_getAccumulatedRepetitiveness)
+        //fprintf(fp,"<col align=\"char\" char=\".\" />");
+        fprintf(fp,"<col align=\"right\" />");
+    fprintf(fp,"<col align=\"left\" />");
+    fprintf(fp,"</colgroup>\n<thead><tr>");
+    if(b_phraseno)
+        fprintf(fp,"<td>#</td>");
+    if(b_realCount)
+        fprintf(fp,"<td>count</td>");
+    if(b_weight)
+        fprintf(fp,"<td>weight</td>");
+    if(b_getAccumulatedRepetitiveness)
+        fprintf(fp,"<td>Acc. repetitiveness</td>");
+    fprintf(fp,"</tr></thead><tbody>\n");
+    }
 
-        if(preambule.bools.b_fuzzy)
-            {
-            fprintf(fp,"<p>fuzzy match level: ");
-            switch(currentFuzzynessBoundary())
-                {
-                case 100:
-                    fprintf(fp,"sentence");
-                    break;
-                case 95:
-                    fprintf(fp,"95%%");
-                    break;
-                case 85:
-                    fprintf(fp,"85%%");
-                    break;
-                case 75:
-                    fprintf(fp,"75%%");
-                    break;
-                case 50:
-                    fprintf(fp,"50%%");
-                    break;
-                case 0:
-                    fprintf(fp,"no limit");
-                    break;
-                default:
-                    fprintf(fp,"%d",currentFuzzynessBoundary());
-                }
-            fprintf(fp,"</p>\n");
+/* <prefix>-<ranking>-<page>.html, with the compression suffix. */
+static void pageName(char * name,size_t size,int rankingNumber,unsigned long pageNumber)
+    {
+    snprintf(name,size,"%s-%d-%lu.html%s",context->pagePrefix,rankingNumber,pageNumber,compressionSuffix(context->markedCompression));
+    }
+
+/* The name without its directory, for links between files in one directory. */
+static const char * baseName(const char * name)
+    {
+    const char * slash = strrchr(name,'/');
+    return slash ? slash + 1 : name;
+    }
+
+pageWriter::pageWriter(int rankingNumber):A(context),rankingNumber(rankingNumber),numberOfPages(0),rows(0)
+    {
+    current.reserve(context->rowsPerPage);
+    worker = std::thread([this]()
+        {
+        run();
+        });
+    }
+
+void pageWriter::handOver(bool last)
+    {
+    std::lock_guard<std::mutex> lock(queueLock);
+    queue.push_back(page());
+    page & P = queue.back();
+    P.rows.swap(current);
+    P.number = ++numberOfPages;
+    P.last = last;
+    queueChanged.notify_one();
+    current.reserve(context->rowsPerPage);
+    }
+
+void pageWriter::writePage(const page & P)
+    {
+    size_t size = strlen(context->pagePrefix) + 64;
+    char * name = new char[size];
+    pageName(name,size,rankingNumber,P.number);
+    FILE * fp = compressingStream(fopen(name,"wb"),context->markedCompression);
+    if(!fp)
+        {
+        fprintf(stderr,"Cannot open %s for writing\n",name);
+        delete [] name;
+        return;
+        }
+    unsigned long first = (P.number - 1) * context->rowsPerPage + 1;
+    header(fp,"phrases");
+    fprintf(fp,"<p>phrases %lu - %lu</p>\n<p>",first,first + P.rows.size() - 1);
+    if(P.number > 1)
+        {
+        pageName(name,size,rankingNumber,P.number - 1);
+        fprintf(fp,"<a href=\"%s\">previous</a> ",baseName(name));
+        }
+    if(!P.last)
+        {
+        pageName(name,size,rankingNumber,P.number + 1);
+        fprintf(fp,"<a href=\"%s\">next</a>",baseName(name));
+        }
+    fprintf(fp,"</p>\n");
+    writeTableHead(fp,true,true,false,false);
+    for(size_t i = 0;i < P.rows.size();++i)
+        P.rows[i]->printsimpleARG(context->morphemes,fp,first + i,true,true,false,false,"<tr>","</tr>\n");
+    fprintf(fp,"</tbody></table>\n");
+    fprintf(fp,"%s\n",
+        "</body>\n"
+        "</html>\n");
+    if(fclose(fp) != 0)
+        fprintf(stderr,"Cannot write %s\n",name);
+    delete [] name;
+    }
+
+void pageWriter::run()
+    {
+    analysisScope scope(A);
+    for(;;)
+        {
+        page P;
+            {
+            std::unique_lock<std::mutex> lock(queueLock);
+            while(queue.empty())
+                queueChanged.wait(lock);
+            P.rows.swap(queue.front().rows);
+            P.number = queue.front().number;
+            P.last = queue.front().last;
+            queue.pop_front();
+            }
+        if(P.number > 0)
+            writePage(P);
+        if(P.last)
+            return;
+        }
+    }
+
+void pageWriter::finish(ranking * R)
+    {
+    if(current.empty())
+        { // stops the thread
+        std::lock_guard<std::mutex> lock(queueLock);
+        queue.push_back(page());
+        queue.back().number = 0;
+        queue.back().last = true;
+        queueChanged.notify_one();
+        }
+    else
+        handOver(true);
+    worker.join();
+    R->numberOfPages = numberOfPages;
+    R->pagedRows = rows;
+    }
+
+/* name as seen from the directory of the file from: the directories that both
+share are left out, and each further directory of from becomes "../". */
+static void relativeName(char * link,size_t size,const char * name,const char * from)
+    {
+    if(from && !strncmp(from,"./",2))
+        from += 2;
+    if(!strncmp(name,"./",2))
+        name += 2;
+    if(!from || (*name == '/') != (*from == '/'))
+        {
+        snprintf(link,size,"%s",name);
+        return;
+        }
+    size_t common = 0;
+    for(size_t i = 0;name[i] && name[i] == from[i];++i)
+        if(name[i] == '/')
+            common = i + 1;
+    size_t n = 0;
+    for(const char * s = from + common;(s = strchr(s,'/')) != NULL && n + 3 < size;++s)
+        n += snprintf(link + n,size - n,"../");
+    snprintf(link + n,size - n,"%s",name + common);
+    }
+
+/* Instead of the table of a ranking, links to its pages. */
+static void writePageLinks(FILE * fp,const ranking * R,int rankingNumber)
+    {
+    size_t size = strlen(context->pagePrefix) + 64;
+    char * name = new char[size];
+    size_t linkSize = size + (context->pageIndex ? 3 * strlen(context->pageIndex) : 0);
+    char * link = new char[linkSize];
+    fprintf(fp,"<p>%lu phrases on %lu pages:</p>\n",R->pagedRows,R->numberOfPages);
+    for(unsigned long p = 1;p <= R->numberOfPages;++p)
+        {
+        unsigned long first = (p - 1) * context->rowsPerPage + 1;
+        unsigned long last = p < R->numberOfPages ? p * context->rowsPerPage : R->pagedRows;
+        pageName(name,size,rankingNumber,p);
+        relativeName(link,linkSize,name,context->pageIndex);
+        fprintf(fp,"<p><a href=\"%s\">%lu - %lu</a></p>\n",link,first,last);
+        }
+    delete [] link;
+    delete [] name;
+    }
+
+void WritePhrasesArgHTML(char ** names,double * versionalikeness,bool morphemes,FILE * fp,flagspreambule preambule,bool b_phraseno,bool b_realCount,bool b_weight, bool b_getAccumulatedRepetitiveness)
+    {
+    if(context->rankings && fp)
+        {
+        header(fp,"phrases");
+        if(preambule.bools.b_task)
+            {
+            fprintf(fp,"<p>task: %s</p>\n",context->versioncomparison ? "version comparison" : "repetitiveness checking");
+            }
+        if(names[1] && context->numberOfRankings == 1)
+            {
+            if(context->rankings[0].approximate)
+                fprintf(fp,"<p>alikeness (lower bound, top %lu phrases only):</p>\n",context->topK);
+            else
+                fprintf(fp,"<p>alikeness:</p>\n");
+            for(int fileno = 0;names[fileno];++fileno)
+                fprintf(fp,"<p>%s: %f</p>\n",names[fileno],versionalikeness[fileno]);
+            }
+
+        if(preambule.bools.b_case_sensitive)
+            {
+            fprintf(fp,"<p>case sensitive: %s</p>\n",context->case_sensitive ? "yes" : "no");
+            }
+
+        if(preambule.bools.b_fuzzy && context->numberOfRankedLevels == 1)
+            {
+            writeFuzzynessHTML(fp,context->rankings[0].fuzzy.boundary);
             }
         if(preambule.bools.b_limit)
             {
             fprintf(fp,"<p>");
-            if(maxlimit >= minlimit)
+            if(context->maxlimit >= context->minlimit)
                 {
-                fprintf(fp,"words/phrase: %d - %d",minlimit,maxlimit);
+                fprintf(fp,"words/phrase: %d - %d",context->minlimit,context->maxlimit);
                 }
             else
                 {
-                fprintf(fp,"words/phrase: %d - unlimited",minlimit);
+                fprintf(fp,"words/phrase: %d - unlimited",context->minlimit);
                 }
             fprintf(fp,"</p>\n");
             }
         if(preambule.bools.b_passes)
             {
-            fprintf(fp,"<p>passes: %d</p>\n",npasses);
+            fprintf(fp,"<p>passes: %d</p>\n",context->npasses);
             }
-        if(preambule.bools.b_weight)
+        for(int r = 0;r < context->numberOfRankings;++r)
             {
-            fprintf(fp,"<p>");
-            if(setWeight == setWeightAsFrequency)
-                fprintf(fp,"weight = phrase frequency");
-            else if(setWeight == setWeightAsLength)
-                fprintf(fp,"weight = phrase length");
-            else if(setWeight == setWeightAsFrequencyTimesLength)
-                fprintf(fp,"weight = phrase frequency * phrase length");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency)
-                fprintf(fp,"weight = phrase frequency * phrase length * average of inverse of word frequency");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency)
-                fprintf(fp,"weight = phrase frequency * phrase length * ratios (average word frequency / real word frequency)");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropy)
-                fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy");
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength)
-                fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy * log(phrase length)");
-    /*            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction)
-                fprintf(fp,"weight = phrase frequency * phrase length * average of word entropy * log(phrase length) * Phrase count reduction factor\n\n");*/
-            else if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction)
-                fprintf(fp,"weight = phrase frequency * phrase length * average of inverse of word frequency * Phrase count reduction factor");
-            else if(setWeight == setWeight2005)
-                fprintf(fp,"weight = 2005");
-            else if(setWeight == setWeight2005b)
-                fprintf(fp,"weight = 2005b");
-            fprintf(fp,"</p>\n");
+            ranking * R = context->rankings + r;
+            if(preambule.bools.b_fuzzy && context->numberOfRankedLevels > 1)
+                {
+                writeFuzzynessHTML(fp,R->fuzzy.boundary);
+                }
+            if(preambule.bools.b_weight)
+                {
+                fprintf(fp,"<p>weight = %s</p>\n",weightDescription(R->setWeight));
+                }
+            if(names[1] && context->numberOfRankings > 1)
+                {
+                if(R->approximate)
+                    fprintf(fp,"<p>alikeness (lower bound, top %lu phrases only):</p>\n",context->topK);
+                else
+                    fprintf(fp,"<p>alikeness:</p>\n");
+                for(int fileno = 0;names[fileno];++fileno)
+                    fprintf(fp,"<p>%s: %f</p>\n",names[fileno],R->alikeness[fileno]);
+                }
+            if(preambule.bools.b_repetitiveness)
+                {
+                if(R->approximate)
+                    fprintf(fp,"<p>repetitiveness &gt;= %f (lower bound, top %lu phrases only)</p>\n",R->repetitiveness,context->topK);
+                else
+                    fprintf(fp,"<p>repetitiveness = %f</p>\n",R->repetitiveness);
+                }
+
+            if(preambule.bools.b_formula)
+                {
+                fprintf(fp,"<p>phrase length = %f + %f * log(phrase #)</p>\n",R->b,R->m);
+                }
+
+            if(context->pagePrefix)
+                {
+                writePageLinks(fp,R,r + 1);
+                continue;
+                }
+            writeTableHead(fp,b_phraseno,b_realCount,b_weight,b_getAccumulatedRepetitiveness);
+
+            unsigned long phraseno = 1;
+            for ( unsigned long p = 0
+                ; p < R->numberOfPhrases
+                ; ++p
+                )
+                {
+                if(R->phrases[p]->printsimpleARG(morphemes,fp, phraseno,b_phraseno,b_realCount,b_weight, b_getAccumulatedRepetitiveness,"<tr>","</tr>\n"))
+                    {
+                    ++phraseno;
+                    }
+                }
+            fprintf(fp,"</tbody></table>\n");
             }
-        if(preambule.bools.b_repetitiveness)
+        fprintf(fp,"%s\n",
+            "</body>\n"
+            "</html>\n");
+        }
+    }
+
+/* The phrase table of the shown ranking, one record per repeated phrase. */
+void WritePhraseTable(FILE * fp,phraseTableFormat format,bool typeNumbers)
+    {
+    if(!context->rankings)
+        return;
+    const ranking * R = context->rankings + context->shownRanking;
+    outputBuffer out(fp);
+    switch(format)
+        {
+        case tsvTable:
+            out.put(typeNumbers ? "rank\tcount\tweight\taccumulated\ttypes\n" : "rank\tcount\tweight\taccumulated\tphrase\n");
+            break;
+        case binaryTable:
+            out.put(typeNumbers ? "RPT1" : "RPW1",4);
+            break;
+        default:
+            ;
+        }
+    unsigned long rank = 0;
+    for(unsigned long p = 0;p < R->numberOfPhrases;++p)
+        {
+        phrase * Phrase = R->phrases[p];
+        if(Phrase->RealCount() <= 1)
+            continue;
+        ++rank;
+        const word * wording = Phrase->Wording();
+        size_t length = Phrase->Length();
+        switch(format)
             {
-            fprintf(fp,"<p>repetitiveness = %f</p>\n",repetitiveness);
+            case tsvTable:
+                out.putUnsigned(rank);
+                out.put('\t');
+                out.putUnsigned(Phrase->RealCount());
+                out.put('\t');
+                out.putFixed(Phrase->Weight());
+                out.put('\t');
+                out.putFixed(Phrase->getAccumulatedRepetitiveness());
+                out.put('\t');
+                for(size_t i = 0;i < length;++i)
+                    {
+                    if(i)
+                        out.put(' ');
+                    if(typeNumbers)
+                        out.putUnsigned(wording[i].tp - context->typeArray);
+                    else
+                        out.put(wording[i].tp->name());
+                    }
+                out.put('\n');
+                break;
+            case jsonlTable:
+                out.put("{\"rank\":");
+                out.putUnsigned(rank);
+                out.put(",\"count\":");
+                out.putUnsigned(Phrase->RealCount());
+                out.put(",\"weight\":");
+                out.putFixed(Phrase->Weight());
+                out.put(",\"accumulated\":");
+                out.putFixed(Phrase->getAccumulatedRepetitiveness());
+                out.put(typeNumbers ? ",\"types\":[" : ",\"words\":[");
+                for(size_t i = 0;i < length;++i)
+                    {
+                    if(i)
+                        out.put(',');
+                    if(typeNumbers)
+                        out.putUnsigned(wording[i].tp - context->typeArray);
+                    else
+                        out.putJSONString(wording[i].tp->name(),context->UTF8);
+                    }
+                out.put("]}\n");
+                break;
+            case binaryTable:
+                out.put32((uint32_t)rank);
+                out.put32((uint32_t)Phrase->RealCount());
+                out.putDouble(Phrase->Weight());
+                out.putDouble(Phrase->getAccumulatedRepetitiveness());
+                out.put32((uint32_t)length);
+                for(size_t i = 0;i < length;++i)
+                    {
+                    if(typeNumbers)
+                        out.put32((uint32_t)(wording[i].tp - context->typeArray));
+                    else
+                        {
+                        const char * name = wording[i].tp->name();
+                        size_t len = strlen(name);
+                        out.put32((uint32_t)len);
+                        out.put(name,len);
+                        }
+                    }
+                break;
             }
+        }
+    }
 
-        if(preambule.bools.b_formula)
+/* The marked spans of the shown ranking, see repetitions.h. */
+void WriteSpanIndex(FILE * fp,bool binary)
+    {
+    if(!context->rankings || !context->filedatalist)
+        return;
+    const ranking * R = context->rankings + context->shownRanking;
+    const char * marked = R->marked;
+    uint32_t * rankAt = new uint32_t[context->afterlastword - context->words1]();
+    uint32_t rank = 0;
+    for(unsigned long p = 0;p < R->numberOfPhrases;++p)
+        if(R->phrases[p]->RealCount() > 1)
+            R->phrases[p]->rankOccurrences(marked,rankAt,++rank);
+    outputBuffer out(fp);
+    int numberOfTexts = 0;
+    for(int fileno = 0;fileno < context->numberOfFiles;++fileno)
+        if(context->filedatalist[fileno].boundary != context->filedatalist[fileno + 1].boundary)
+            ++numberOfTexts;
+    if(binary)
+        {
+        out.put("RPS1",4);
+        out.put32(context->UTF8);
+        out.put32(numberOfTexts);
+        }
+    else
+        {
+        out.put(context->UTF8 ? "# encoding\tUTF-8\n" : "# encoding\tISO-8859-1\n");
+        }
+    // the texts that have tokens, with the end of their last token
+    for(int fileno = 0;fileno < context->numberOfFiles;++fileno)
+        {
+        const filedata * pfile = context->filedatalist + fileno;
+        if(pfile->boundary == pfile[1].boundary)
+            continue;
+        size_t end = std::min((size_t)pfile[1].boundary[-1].fileEndPos,pfile->length);
+        if(binary)
             {
-            fprintf(fp,"<p>phrase length = %f + %f * log(phrase #)</p>\n",b,m);
+            out.put64(end);
+            out.put32((uint32_t)strlen(pfile->filename));
+            out.put(pfile->filename);
             }
-
-        fprintf(fp,"<table><colgroup>");
-        if(b_phraseno)
-            fprintf(fp,"<col align=\"right\" />");
-        if(b_realCount)
-            fprintf(fp,"<col align=\"right\" />");
-        if(b_weight)
-            //fprintf(fp,"<col align=\"char\" char=\".\" />");
-            fprintf(fp,"<col align=\"right\" />");
-        if(b_getAccumulatedRepetitiveness)
-            //fprintf(fp,"<col align=\"char\" char=\".\" />");
-            fprintf(fp,"<col align=\"right\" />");
-        fprintf(fp,"<col align=\"left\" />");
-        fprintf(fp,"</colgroup>\n<thead><tr>");
-        if(b_phraseno)
-            fprintf(fp,"<td>#</td>");
-        if(b_realCount)
-            fprintf(fp,"<td>count</td>");
-        if(b_weight)
-            fprintf(fp,"<td>weight</td>");
-        if(b_getAccumulatedRepetitiveness)
-            fprintf(fp,"<td>Acc. repetitiveness</td>");
-        fprintf(fp,"</tr></thead><tbody>\n");
-
-        unsigned long phraseno = 1;
-        for ( unsigned long p = 0
-            ; p < numberOfPhrases
-            ; ++p
-            )
+        else
             {
-            if(phrases[p]->printsimpleARG(morphemes,fp, phraseno,b_phraseno,b_realCount,b_weight, b_getAccumulatedRepetitiveness,"<tr>","</tr>\n"))
+            out.put("# file\t");
+            out.putUnsigned(end);
+            out.put('\t');
+            out.put(pfile->filename);
+            out.put('\n');
+            }
+        }
+    if(!binary)
+        out.put("file\tstart\tend\trank\tjoined\n");
+    int textno = 0;
+    for(int fileno = 0;fileno < context->numberOfFiles;++fileno)
+        {
+        const filedata * pfile = context->filedatalist + fileno;
+        if(pfile->boundary == pfile[1].boundary)
+            continue;
+        bool endofcode = false;
+        bool joined = false;
+        size_t start = 0;
+        uint32_t spanRank = 0;
+        for(word * i = pfile->boundary;i < pfile[1].boundary;++i)
+            {
+            size_t w = i - context->words1;
+            if(marked[w] & _b_)
                 {
-                ++phraseno;
+                joined = endofcode;
+                endofcode = false;
+                start = std::min((size_t)i->fileStartPos,pfile->length);
+                spanRank = rankAt[w];
+                }
+            else
+                endofcode = false;
+            if(marked[w] & _e_)
+                {
+                size_t end = std::min((size_t)i->fileEndPos,pfile->length);
+                if(binary)
+                    {
+                    out.put32(textno);
+                    out.put64(start);
+                    out.put64(end);
+                    out.put32(spanRank);
+                    out.put32(joined);
+                    }
+                else
+                    {
+                    out.put(pfile->filename);
+                    out.put('\t');
+                    out.putUnsigned(start);
+                    out.put('\t');
+                    out.putUnsigned(end);
+                    out.put('\t');
+                    out.putUnsigned(spanRank);
+                    out.put(joined ? "\t1\n" : "\t0\n");
+                    }
+                endofcode = true;
                 }
             }
-        fprintf(fp,"</tbody></table>\n");
-        fprintf(fp,"%s\n",
-            "</body>\n"
-            "</html>\n");
+        ++textno;
         }
+    delete [] rankAt;
+    }
+
+const char * GetTypeName(unsigned long typeNumber)
+    {
+    return typeNumber < context->types ? context->typeArray[typeNumber].name() : NULL;
     }
 
 struct indexentry
@@ -2149,163 +3620,331 @@ struct indexentry
         }*/
     };
 
-static int replacement_for_string_constituent[256];
-
-#if DOUNICODE
-#if UNICODE_CAPABLE
-bool case_sensitive = false;
-#else
-bool case_sensitive = true;
-#endif
-#else
-bool case_sensitive = false;
-#endif
-static unsigned long numberOfBytes = 0L;
-
-static FILE *fpi = NULL;
-static char * ptextBuffer = NULL;
-static indexentry * theBigIndex = NULL;
-
 static void karcopy(int kar)
     {
-    *ptextBuffer++ = (char)kar;
+    *context->ptextBuffer++ = (char)kar;
     }
 
 static void karicopy(int kar)
     {
 #if UNICODE_CAPABLE
-    *ptextBuffer++ = (char)kar;
+    *context->ptextBuffer++ = (char)kar;
 #else
     if(kar >= 192 && kar < 224)
-        *ptextBuffer++ = (char)(kar + 32);
+        *context->ptextBuffer++ = (char)(kar + 32);
     else
-        *ptextBuffer++ = (char)tolower(kar);
+        *context->ptextBuffer++ = (char)tolower(kar);
 #endif
     }
 
-int
-#ifdef __BORLANDC__
-    _USERENTRY
-#endif
-    wordComp(const void *a, const void *b)
+/* The token index is sorted on the case folded text of the tokens. The folded
+text is computed once per token. Tokens with the same folded text are sorted
+with the ones starting with an upper case letter first and otherwise on
+position. */
+typedef struct sortentry
     {
-    indexentry ** A = (indexentry **)a;
-    indexentry ** B = (indexentry **)b;
-#if UNICODE_CAPABLE    
-    int cmp = strCaseCmp((*A)->wordpointer,(*B)->wordpointer);
-#else
-    int cmp = strcmp((*A)->wordpointer,(*B)->wordpointer);
+    const unsigned char * key; // folded text, zero terminated
+    indexentry * entry;
+    bool upper; // first character is upper case
+    } sortentry;
+
+#define TOKENSPERTHREAD 100000
+#define MSDLIMIT 1024 // smaller buckets are sorted with multikey quicksort
+#define INSERTIONLIMIT 16 // smaller buckets are sorted with insertion sort
+
+#if UNICODE_CAPABLE
+/* Writes the folded text of s to key, unless key is NULL. Returns the number
+of bytes of the folded text, including the terminating zero. */
+static size_t foldKey(const char * s,unsigned char * key)
+    {
+    bool UTF8 = context->UTF8;
+    char buf[8];
+    size_t len = 0;
+    int kar;
+    while((kar = lowerEquivalent(getUTF8char(s,UTF8))) != 0)
+        len += UnicodeToUtf8(kar,key ? (char *)key + len : buf,6);
+    if(key)
+        key[len] = '\0';
+    return len + 1;
+    }
 #endif
-    if(cmp == 0)
+
+static bool tieLess(const sortentry & A,const sortentry & B)
+    {
+    /* If a type can be written with upper case but also with lower case, 
+    prefer the lower case version, just to please the eye: */
+    if(A.upper != B.upper)
+        return A.upper;
+    return A.entry < B.entry;
+    }
+
+static void sortTies(sortentry * a,size_t n)
+    {
+    std::sort(a,a + n,tieLess);
+    }
+
+static bool entryLess(const sortentry & A,const sortentry & B,size_t depth)
+    {
+    int cmp = strcmp((const char *)A.key + depth,(const char *)B.key + depth);
+    return cmp < 0 || (cmp == 0 && tieLess(A,B));
+    }
+
+static void insertionSortEntries(sortentry * a,size_t n,size_t depth)
+    {
+    for(size_t i = 1;i < n;++i)
         {
-        int AA = UTF8char((*A)->wordpointer,globUTF8);
-        int BB = UTF8char((*B)->wordpointer,globUTF8);
-        /* If a type can be written with upper case but also with lower case, 
-        prefer the lower case version, just to please the eye: */
-        if(isUpper(AA))
+        sortentry x = a[i];
+        size_t j = i;
+        for(;j > 0 && entryLess(x,a[j - 1],depth);--j)
+            a[j] = a[j - 1];
+        a[j] = x;
+        }
+    }
+
+/* Three way radix quicksort on the character at depth. */
+static void multikeyQuicksort(sortentry * a,size_t n,size_t depth)
+    {
+    while(n > INSERTIONLIMIT)
+        {
+        unsigned char x = a[0].key[depth];
+        unsigned char y = a[n / 2].key[depth];
+        unsigned char z = a[n - 1].key[depth];
+        unsigned char pivot = x < y ? (y < z ? y : (x < z ? z : x)) 
+                                    : (x < z ? x : (y < z ? z : y));
+        size_t lt = 0, i = 0, gt = n;
+        while(i < gt)
             {
-            if(isLower(BB))
-                return -1;
+            unsigned char c = a[i].key[depth];
+            if(c < pivot)
+                std::swap(a[lt++],a[i++]);
+            else if(c > pivot)
+                std::swap(a[i],a[--gt]);
+            else
+                ++i;
             }
-        else if(isUpper(BB))
+        multikeyQuicksort(a,lt,depth);
+        multikeyQuicksort(a + gt,n - gt,depth);
+        if(pivot == 0)
             {
-            return 1;
+            sortTies(a + lt,gt - lt);
+            return;
             }
+        a += lt;
+        n = gt - lt;
+        ++depth;
+        }
+    insertionSortEntries(a,n,depth);
+    }
 
-        if((*A) > (*B))
-            return 1;
-        return -1;
+/* Distributes a over 256 buckets on the character at depth, using tmp. Skips
+characters that all entries have in common. Returns false if all entries have
+the same key. */
+static bool distributeEntries(sortentry * a,sortentry * tmp,size_t n,size_t & depth,size_t * start)
+    {
+    size_t count[256];
+    for(;;)
+        {
+        memset(count,0,sizeof(count));
+        for(size_t i = 0;i < n;++i)
+            ++count[a[i].key[depth]];
+        unsigned char c = a[0].key[depth];
+        if(count[c] < n)
+            break;
+        if(c == 0)
+            return false;
+        ++depth;
+        }
+    size_t sum = 0;
+    for(int c = 0;c < 256;++c)
+        {
+        start[c] = sum;
+        sum += count[c];
+        }
+    start[256] = n;
+    size_t next[256];
+    memcpy(next,start,sizeof(next));
+    for(size_t i = 0;i < n;++i)
+        tmp[next[a[i].key[depth]]++] = a[i];
+    memcpy(a,tmp,n * sizeof(a[0]));
+    return true;
+    }
+
+/* MSD radix sort. tmp has room for n entries. */
+static void msdRadixSort(sortentry * a,sortentry * tmp,size_t n,size_t depth)
+    {
+    if(n < MSDLIMIT)
+        {
+        multikeyQuicksort(a,n,depth);
+        return;
+        }
+    size_t start[257];
+    if(!distributeEntries(a,tmp,n,depth,start))
+        {
+        sortTies(a,n);
+        return;
+        }
+    sortTies(a,start[1]);
+    for(int c = 1;c < 256;++c)
+        {
+        size_t m = start[c + 1] - start[c];
+        if(m > 1)
+            msdRadixSort(a + start[c],tmp + start[c],m,depth + 1);
         }
-    return cmp;
     }
 
-static indexentry ** pindex;
+/* Sorts pindex. The first character splits the index in buckets that are
+sorted in parallel, each bucket by the first thread that is free. */
+static void sortIndex()
+    {
+    if(context->tokens < 2)
+        return;
+    sortentry * entries = new sortentry[context->tokens];
+#if UNICODE_CAPABLE
+    size_t * offset = new size_t[context->tokens + 1];
+    parallelForAnalysis(context->tokens,TOKENSPERTHREAD,[=](unsigned long first,unsigned long last)
+        {
+        for(unsigned long j = first;j < last;++j)
+            offset[j + 1] = foldKey(context->pindex[j]->wordpointer,NULL);
+        });
+    offset[0] = 0;
+    for(unsigned long j = 0;j < context->tokens;++j)
+        offset[j + 1] += offset[j];
+    unsigned char * keys = new unsigned char[offset[context->tokens]];
+#endif
+    parallelForAnalysis(context->tokens,TOKENSPERTHREAD,[=](unsigned long first,unsigned long last)
+        {
+        for(unsigned long j = first;j < last;++j)
+            {
+            bool UTF8 = context->UTF8;
+#if UNICODE_CAPABLE
+            foldKey(context->pindex[j]->wordpointer,keys + offset[j]);
+            entries[j].key = keys + offset[j];
+#else
+            entries[j].key = (const unsigned char *)context->pindex[j]->wordpointer;
+#endif
+            entries[j].entry = context->pindex[j];
+            entries[j].upper = isUpper(UTF8char(context->pindex[j]->wordpointer,UTF8));
+            }
+        });
+    sortentry * tmp = new sortentry[context->tokens];
+    size_t start[257];
+    size_t depth = 0;
+    if(context->tokens < MSDLIMIT || numberOfThreads() == 1)
+        msdRadixSort(entries,tmp,context->tokens,0);
+    else if(!distributeEntries(entries,tmp,context->tokens,depth,start))
+        sortTies(entries,context->tokens);
+    else
+        {
+        std::atomic<int> nextBucket(0);
+        parallelForAnalysis(numberOfThreads(),1,[&](unsigned long,unsigned long)
+            {
+            int c;
+            while((c = nextBucket++) < 256)
+                {
+                size_t m = start[c + 1] - start[c];
+                if(c == 0)
+                    sortTies(entries,m);
+                else if(m > 1)
+                    msdRadixSort(entries + start[c],tmp + start[c],m,depth + 1);
+                }
+            });
+        }
+    for(unsigned long j = 0;j < context->tokens;++j)
+        context->pindex[j] = entries[j].entry;
+    delete [] tmp;
+    delete [] entries;
+#if UNICODE_CAPABLE
+    delete [] keys;
+    delete [] offset;
+#endif
+    }
 
 void countTypes()
     {
-    if(pindex[0])
+    if(context->pindex[0])
         {
-        char * prev = pindex[0]->wordpointer;
-        pindex[0]->lastOfType = false;
-        types = 1L;
+        char * prev = context->pindex[0]->wordpointer;
+        context->pindex[0]->lastOfType = false;
+        context->types = 1L;
         unsigned long frequency = 1L;
-        lowestfreq = ULONG_MAX;
-        highestfreq = 0L;
+        context->lowestfreq = ULONG_MAX;
+        context->highestfreq = 0L;
         unsigned long j;
         for ( j = 1
-            ; j < tokens
+            ; j < context->tokens
             ; ++j
             )
             {
 #if UNICODE_CAPABLE    
-            if(strCaseCmp(prev,pindex[j]->wordpointer))
+            if(strCaseCmp(prev,context->pindex[j]->wordpointer))
 #else
-            if(strcmp(prev,pindex[j]->wordpointer))
+            if(strcmp(prev,context->pindex[j]->wordpointer))
 #endif
                 {
-                prev = pindex[j]->wordpointer;
-                if(frequency < lowestfreq)
+                prev = context->pindex[j]->wordpointer;
+                if(frequency < context->lowestfreq)
                     {
-                    lowestfreq = frequency;
-                    lowtype = types - 1;
+                    context->lowestfreq = frequency;
+                    context->lowtype = context->types - 1;
                     }
-                if(frequency > highestfreq)
+                if(frequency > context->highestfreq)
                     {
-                    highestfreq = frequency;
-                    hightype = types - 1;
+                    context->highestfreq = frequency;
+                    context->hightype = context->types - 1;
                     }
-                ++types;
-                pindex[j-1]->lastOfType = true;
+                ++context->types;
+                context->pindex[j-1]->lastOfType = true;
                 frequency = 1L;
                 }
             else
                 {
                 ++frequency;
-                pindex[j-1]->lastOfType = false;
+                context->pindex[j-1]->lastOfType = false;
                 }
             }
-        pindex[j-1]->lastOfType = true;
+        context->pindex[j-1]->lastOfType = true;
         }
     }
 
-enum Inside {nowhere,instring,indelimiter,inignored,inatomic,insentencedelimiter};
-static Inside inside = nowhere;
-static void countbewerk(void)
+static void countbewerk(const filedata * pfile)
     {
     bool eof = false, lf = true;
+    size_t pos = 0;
     do
         {
-        int ikar = fgetc(fpi);
-        if(ikar == EOF)
+        int ikar;
+        if(pos < pfile->length)
+            ikar = (unsigned char)pfile->text[pos++];
+        else
             {
             eof = true;
             ikar = '\0';
             }
-        switch(character[ikar])
+        switch(context->character[ikar])
             {
             case string_constituent:
                 {
-                if(inside != instring)
+                if(context->inside != instring)
                     {
                     lf = false;
-                    inside = instring;
+                    context->inside = instring;
                     }
-                ++numberOfBytes;
+                ++context->numberOfBytes;
                 break;
                 }
             case string_constituent_to_be_replaced:
                 {
-                if(inside != instring)
+                if(context->inside != instring)
                     {
                     lf = false;
-                    inside = instring;
+                    context->inside = instring;
                     }
-                if(replacement_for_string_constituent[ikar])
-                    ++numberOfBytes;
+                if(context->replacement_for_string_constituent[ikar])
+                    ++context->numberOfBytes;
                 else
                     if (!lf)
                         {
-                        ++tokens;
+                        ++context->tokens;
                         lf = true;
                         }
                 break;
@@ -2314,39 +3953,39 @@ static void countbewerk(void)
                 {
                 if (!lf)
                     {
-                    ++tokens;
+                    ++context->tokens;
                     lf = true;
                     }
-                inside = indelimiter;
+                context->inside = indelimiter;
                 break;
                 }
             case sentence_delimiter:
                 {
                 if (!lf)
                     {
-                    ++tokens;
+                    ++context->tokens;
                     lf = true;
                     }
-                ++numberOfBytes;
-                ++tokens;
-                inside = insentencedelimiter;
+                ++context->numberOfBytes;
+                ++context->tokens;
+                context->inside = insentencedelimiter;
                 break;
                 }
             case ignored_symbol:
                 {
-                inside = inignored;
+                context->inside = inignored;
                 break;
                 }
             case atomic_string:
                 {
                 if (!lf)
                     {
-                    ++tokens;
+                    ++context->tokens;
                     lf = true;
                     }
-                ++numberOfBytes;
-                ++tokens;
-                inside = inatomic;
+                ++context->numberOfBytes;
+                ++context->tokens;
+                context->inside = inatomic;
                 break;
                 }
             default:
@@ -2358,50 +3997,52 @@ static void countbewerk(void)
 
 static void newtoken(long end)
     {
-    words1[tokens].fileEndPos = end;
-    *ptextBuffer++ = '\0';
-    ++tokens;
-    theBigIndex[tokens].wordpointer = ptextBuffer;
+    context->words1[context->tokens].fileEndPos = end;
+    *context->ptextBuffer++ = '\0';
+    ++context->tokens;
+    context->theBigIndex[context->tokens].wordpointer = context->ptextBuffer;
     }
 
-static void copybewerk(void (*uitvoer)(int kar))
+static void copybewerk(const filedata * pfile,void (*uitvoer)(int kar))
     {
     bool eof = false,lf = true;
     do
         {
-        int ikar = fgetc(fpi);
-        if(ikar == EOF)
+        int ikar;
+        if((size_t)context->inpos < pfile->length)
+            ikar = (unsigned char)pfile->text[context->inpos];
+        else
             {
             eof = true;
             ikar = '\0';
             }
-        switch(character[ikar])
+        switch(context->character[ikar])
             {
             case string_constituent:
                 {
-                if(inside != instring)
+                if(context->inside != instring)
                     {
                     lf = false;
-                    inside = instring;
-                    words1[tokens].fileStartPos = inpos;
+                    context->inside = instring;
+                    context->words1[context->tokens].fileStartPos = context->inpos;
                     }
                 uitvoer(ikar);
                 break;
                 }
             case string_constituent_to_be_replaced:
                 {
-                if(inside != instring)
+                if(context->inside != instring)
                     {
                     lf = false;
-                    inside = instring;
-                    words1[tokens].fileStartPos = inpos;
+                    context->inside = instring;
+                    context->words1[context->tokens].fileStartPos = context->inpos;
                     }
-                if(replacement_for_string_constituent[ikar])
-                    uitvoer(replacement_for_string_constituent[ikar]);
+                if(context->replacement_for_string_constituent[ikar])
+                    uitvoer(context->replacement_for_string_constituent[ikar]);
                 else
                     if (!lf)
                         {
-                        newtoken(inpos);
+                        newtoken(context->inpos);
                         lf = true;
                         }
                 break;
@@ -2410,31 +4051,31 @@ static void copybewerk(void (*uitvoer)(int kar))
                 {
                 if (!lf)
                     {
-                    newtoken(inpos);
+                    newtoken(context->inpos);
                     lf = true;
                     }
-                inside = indelimiter;
+                context->inside = indelimiter;
                 break;
                 }
             case sentence_delimiter:
                 {
                 if (!lf)
                     {
-                    newtoken(inpos);
+                    newtoken(context->inpos);
                     lf = true;
                     }
-                words1[tokens].fileStartPos = inpos;
+                context->words1[context->tokens].fileStartPos = context->inpos;
                 uitvoer(ikar);
-                newtoken(inpos + 1L);
-                inside = insentencedelimiter;
+                newtoken(context->inpos + 1L);
+                context->inside = insentencedelimiter;
                 break;
                 }
             case ignored_symbol:
                 {
-                if(inside != inignored)
+                if(context->inside != inignored)
                     {
-                    inside = inignored;
-                    words1[tokens].fileEndPos = inpos;
+                    context->inside = inignored;
+                    context->words1[context->tokens].fileEndPos = context->inpos;
                     }
                 break;
                 }
@@ -2442,160 +4083,325 @@ static void copybewerk(void (*uitvoer)(int kar))
                 {
                 if (!lf)
                     {
-                    newtoken(inpos);
+                    newtoken(context->inpos);
                     lf = true;
                     }
-                words1[tokens].fileStartPos = inpos;
+                context->words1[context->tokens].fileStartPos = context->inpos;
                 uitvoer(ikar);
-                newtoken(inpos + 1L);
-                inside = inatomic;
+                newtoken(context->inpos + 1L);
+                context->inside = inatomic;
                 break;
                 }
             default:
                 ;
             }
-        inpos++;
+        context->inpos++;
         }
     while(!eof);
     }
 
-static void ReadTexts(const char ** sis)
+/* The tables that all analyses share are filled by the first ReadTexts. */
+static std::once_flag tablesFilled;
+
+static void fillTables()
     {
-    const char ** psi;
-    unsigned long i;
-    unsigned long j;
-    int nofiles;
+    initPostingDecoder();
+    logfac[0] = 0; // log 0!
+    for(unsigned long i = 1;i < sizeof(logfac)/sizeof(logfac[0]);++i)
+        logfac[i] = logfac[i-1] + log(double(i));
+    }
 
-    tokens = 0L;
-    numberOfBytes = 0L;
-    for(psi = sis,nofiles = 0;*psi;++psi,++nofiles)
+static void computeTypeStatistics()
+    {
+    context->typeStats = context->memory.newArray<typestat>(context->types);
+    for(unsigned long i = 0;i < context->types;++i)
         {
-        fpi = fopen(*psi,"rb");
-        if(fpi)
-            {
-            inpos = 0L;
-            countbewerk();
-            fclose(fpi);
-            }
+        double freq = context->typeArray[i].getFrequency();
+        double prob = 1.0/freq;
+        context->typeStats[i].inverseFrequency = prob;
+        context->typeStats[i].entropy = -prob * log(prob);
+        context->typeStats[i].ratio = context->typeArray[i].isWord() ? context->averageTypeFrequency/freq : 1.0;
+        context->typeStats[i].logFrequency = log(freq);
+        context->typeStats[i].probability = freq/(double)context->tokens;
         }
+    context->logTokens = log((double)context->tokens);
+    }
 
-    if(filedatalist)
-        delete [] filedatalist;
-
-    filedatalist = new filedata[nofiles+1];
-
-    if(textBuffer)
-        delete [] textBuffer;
-
-    textBuffer = new char[numberOfBytes + tokens]; // (reserve one byte for indicating the end of a word)
-    ptextBuffer = textBuffer;
+void EndAnalysis()
+    {
+    context->rankings = NULL;
+    context->numberOfRankings = 0;
+    context->numberOfRankedLevels = 0;
+    for(int d = 0;d < context->numberOfDiscoveries;++d)
+        context->discoveries[d].records = NULL;
+    context->numberOfDiscoveries = 0;
+    context->typeStats = NULL;
+    context->tokenIds = NULL;
+    context->postingData = NULL;
+    context->nameOrder = NULL;
+    context->vocabulary = NULL;
+    context->typeArray = NULL;
+    context->filedatalist = NULL;
+    context->words1 = context->lastword = context->afterlastword = NULL;
+    context->unmapFiles();
+    context->memory.reset();
+    }
 
-    theBigIndex = new indexentry[tokens + 1]; // last entry is not used.
-    theBigIndex[0].wordpointer = ptextBuffer;
-    if(words1)
-        delete [] words1;
-    words1 = new word[tokens + 1]; // last element not used, but introduced to eliminate expensive "if"
-    afterlastword = words1 + tokens;
-    lastword = afterlastword - 1;
-    gtokens = tokens;
-    tokens = 0L;
-    words1[0].fileStartPos = -1L;
-    filedata * pfile = filedatalist;
-    for(psi = sis;*psi;++psi,++pfile)
+/* Maps a regular file into memory, or else reads it into the arena of the
+analysis. */
+static bool readFile(const char * name,textInput & input)
+    {
+    FILE * fp = fopen(name,"rb");
+    if(!fp)
+        return false;
+    input.name = name;
+    struct stat st;
+    if(fstat(fileno(fp),&st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
         {
-        pfile->filename = new char[strlen(*psi)+1];
-        strcpy(pfile->filename,*psi);
-        fpi = fopen(*psi,"rb");
-        if(fpi)
+        void * address = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fileno(fp),0);
+        if(address != MAP_FAILED)
             {
-            inpos = 0L;
-            pfile->boundary = words1 + tokens;
-            if(case_sensitive)
-                copybewerk(karcopy);
-            else
-                copybewerk(karicopy);
-            fclose(fpi);
+            fclose(fp);
+            analysis::mappedFile * M = context->memory.newArray<analysis::mappedFile>(1);
+            M->address = address;
+            M->length = st.st_size;
+            M->next = context->mappedFiles;
+            context->mappedFiles = M;
+            input.text = (const char *)address;
+            input.length = st.st_size;
+            return true;
             }
-        else
+        }
+    char * text;
+    size_t length = 0;
+    long size = fseek(fp,0L,SEEK_END) == 0 ? ftell(fp) : -1L;
+    if(size >= 0 && fseek(fp,0L,SEEK_SET) == 0)
+        {
+        text = context->memory.newArray<char>(size);
+        length = fread(text,1,size,fp);
+        }
+    else
+        { // a pipe or the like
+        size_t capacity = 65536;
+        char * data = (char *)malloc(capacity);
+        size_t n;
+        while(data && (n = fread(data + length,1,capacity - length,fp)) > 0)
             {
-            fprintf(stderr,"Cannot open %s for reading\n",pfile->filename);
-            exit(-13);
+            length += n;
+            if(length == capacity)
+                data = (char *)realloc(data,capacity *= 2);
             }
+        text = context->memory.newArray<char>(length);
+        if(data)
+            memcpy(text,data,length);
+        free(data);
+        }
+    fclose(fp);
+    input.text = text;
+    input.length = length;
+    return true;
+    }
+
+/* Tokenizes the texts where they are. They must stay put until EndAnalysis. */
+static void TokenizeTexts(const textInput * texts,int nofiles)
+    {
+    unsigned long i;
+    unsigned long j;
+    filedata * pfile;
+    int fileno;
+
+    context->UTF8 = true;
+    context->filedatalist = context->memory.newArray<filedata>(nofiles+1);
+    for(fileno = 0,pfile = context->filedatalist;fileno < nofiles;++fileno,++pfile)
+        {
+        pfile->filename = context->memory.newArray<char>(strlen(texts[fileno].name)+1);
+        strcpy(pfile->filename,texts[fileno].name);
+        pfile->text = texts[fileno].text;
+        pfile->length = texts[fileno].length;
+        }
+    context->tokens = 0L;
+    context->numberOfBytes = 0L;
+    for(fileno = 0;fileno < nofiles;++fileno)
+        countbewerk(context->filedatalist + fileno);
+    if((unsigned long)(uint32_t)context->tokens != context->tokens)
+        {
+        fprintf(stderr,"Too many tokens (%lu), the posting lists can address at most %lu\n",context->tokens,(unsigned long)UINT32_MAX);
+        exit(-14);
+        }
+
+    if(context->textBuffer)
+        delete [] context->textBuffer;
+
+    context->textBuffer = new char[context->numberOfBytes + context->tokens]; // (reserve one byte for indicating the end of a word)
+    context->ptextBuffer = context->textBuffer;
+
+    context->theBigIndex = new indexentry[context->tokens + 1]; // last entry is not used.
+    context->theBigIndex[0].wordpointer = context->ptextBuffer;
+    context->words1 = context->memory.newArray<word>(context->tokens + 1); // last element not used, but introduced to eliminate expensive "if"
+    context->afterlastword = context->words1 + context->tokens;
+    context->lastword = context->afterlastword - 1;
+    context->gtokens = context->tokens;
+    context->tokens = 0L;
+    context->words1[0].fileStartPos = -1L;
+    for(fileno = 0,pfile = context->filedatalist;fileno < nofiles;++fileno,++pfile)
+        {
+        context->inpos = 0L;
+        pfile->boundary = context->words1 + context->tokens;
+        if(context->case_sensitive)
+            copybewerk(pfile,karcopy);
+        else
+            copybewerk(pfile,karicopy);
         }
     pfile->filename = NULL;
-    pfile->boundary = words1 + tokens;
-    pindex = new indexentry * [tokens + 1]; // last entry is not used.
-    pindex[tokens] = NULL;
+    pfile->boundary = context->words1 + context->tokens;
+    context->numberOfFiles = nofiles;
+    context->pindex = new indexentry * [context->tokens + 1]; // last entry is not used.
+    context->pindex[context->tokens] = NULL;
     for ( j = 0
-        ; j </*=*/ tokens
+        ; j </*=*/ context->tokens
         ; ++j
         )
-        pindex[j] = theBigIndex + j;
+        context->pindex[j] = context->theBigIndex + j;
 #ifdef TEST
     FILE *fpo;
     if((fpo = fopen("\\num.txt","wb")) != NULL)
         {
         for ( j = 0
-            ; j < tokens
+            ; j < context->tokens
             ; ++j
             )
-            fprintf(fpo,"%lu:%s\n",j,pindex[j]->wordpointer);
+            fprintf(fpo,"%lu:%s\n",j,context->pindex[j]->wordpointer);
         fclose(fpo);
         }
 #endif
-    qsort(pindex,tokens,sizeof(pindex[0]),wordComp);
+    sortIndex();
     countTypes();
-    averageTypeFrequency = (double)tokens / (double)types;
+    context->averageTypeFrequency = (double)context->tokens / (double)context->types;
 #ifdef TEST
     if((fpo = fopen("\\sorted.txt","wb")) != NULL)
         {
         for ( j = 0
-            ; j < tokens
+            ; j < context->tokens
             ; ++j
             )
-            fprintf(fpo,"%lu:%d:%s\n",j,pindex[j]->lastOfType,pindex[j]->wordpointer);
+            fprintf(fpo,"%lu:%d:%s\n",j,context->pindex[j]->lastOfType,context->pindex[j]->wordpointer);
         fclose(fpo);
         }
 #endif
-    if(typeArray)
-        delete [] typeArray;
-    typeArray = new type[types];
-    if(pwordlist)
-        delete [] pwordlist;
-    pwordlist = new word * [tokens];
-    for(i = 0;i < tokens;++i)
-        {
-        words1[i].marked = _f_;
-        words1[i].tp = NULL;
-        }
-
-	assert(lastword == words1 + i - 1);
-	assert(afterlastword == words1 + i);
+    context->typeArray = context->memory.newArray<type>(context->types);
+    /* The type names are copied to the vocabulary, after which the text of
+    the tokens is not needed anymore. */
+    size_t vocabularySize = 0;
+    for(j = 0;j < context->tokens;++j)
+        if(context->pindex[j]->lastOfType)
+            vocabularySize += strlen(context->pindex[j]->wordpointer) + 1;
+    context->vocabulary = context->memory.newArray<char>(vocabularySize);
+    char * pvocabulary = context->vocabulary;
+    uint32_t * positions = new uint32_t[context->tokens]; // grouped by type, in alphabetical order
+    unsigned long * firstPosition = new unsigned long[context->types + 1]; // per type, in alphabetical order
+    context->nameOrder = context->memory.newArray<unsigned long>(context->types);
+    context->types = 0L;
+    firstPosition[0] = 0L;
+    for(j = 0;j < context->tokens;++j)
+        if(context->pindex[j]->lastOfType)
+            firstPosition[++context->types] = j + 1;
+    unsigned long * frequencyOrder = new unsigned long[context->types];
+    for(i = 0;i < context->types;++i)
+        frequencyOrder[i] = i;
+    std::stable_sort(frequencyOrder,frequencyOrder + context->types,[firstPosition](unsigned long a,unsigned long b)
+        {
+        return firstPosition[a + 1] - firstPosition[a] > firstPosition[b + 1] - firstPosition[b];
+        });
+    for(i = 0;i < context->types;++i)
+        context->nameOrder[frequencyOrder[i]] = i;
+    for(i = 0;i < context->tokens;++i)
+        {
+        context->words1[i].tp = NULL;
+        }
+
+	assert(context->lastword == context->words1 + i - 1);
+	assert(context->afterlastword == context->words1 + i);
 
     unsigned long frequency = 0L;
-    types = 0L;
+    context->types = 0L;
     for ( j = 0
-        ; j < tokens
+        ; j < context->tokens
         ; ++j
         )
         {
-        word * wordp = words1 + (pindex[j] - theBigIndex);
-        pwordlist[j] = wordp;
-        wordp->tp = typeArray + types;
+        word * wordp = context->words1 + (context->pindex[j] - context->theBigIndex);
+        positions[j] = (uint32_t)(context->pindex[j] - context->theBigIndex);
+        wordp->tp = context->typeArray + context->nameOrder[context->types];
 		assert(wordp->tp);
         ++frequency;
-        if(pindex[j]->lastOfType)
+        if(context->pindex[j]->lastOfType)
             {
-            typeArray[types].create(pindex[j]->wordpointer,pwordlist + (j + 1) - frequency,frequency);
+            size_t len = strlen(context->pindex[j]->wordpointer) + 1;
+            memcpy(pvocabulary,context->pindex[j]->wordpointer,len);
+            context->typeArray[context->nameOrder[context->types]].create(pvocabulary,frequency);
+            pvocabulary += len;
             frequency = 0L;
-            ++types;
+            ++context->types;
             }
         }
-    delete [] theBigIndex;
-    theBigIndex = NULL;
+    std::call_once(tablesFilled,fillTables);
+    size_t postingSize = 0;
+    for(i = 0;i < context->types;++i)
+        postingSize += encodePostings(positions + firstPosition[frequencyOrder[i]],context->typeArray[i].getFrequency(),NULL);
+    context->postingData = context->memory.newArray<unsigned char>(postingSize + POSTINGPADDING);
+    memset(context->postingData + postingSize,0,POSTINGPADDING);
+    unsigned char * ppostingData = context->postingData;
+    for(i = 0;i < context->types;++i)
+        {
+        context->typeArray[i].setPostings(ppostingData);
+        ppostingData += encodePostings(positions + firstPosition[frequencyOrder[i]],context->typeArray[i].getFrequency(),ppostingData);
+        }
+    if(context->types > 0)
+        {
+        context->lowtype = context->nameOrder[context->lowtype];
+        context->hightype = context->nameOrder[context->hightype];
+        }
+    context->tokenIds = context->memory.newArray<uint32_t>(context->tokens + KERNELWIDTH - 1);
+    for(i = 0;i < context->tokens;++i)
+        context->tokenIds[i] = context->words1[i].tp ? (uint32_t)(context->words1[i].tp - context->typeArray) : NOTYPE;
+    for(;i < context->tokens + KERNELWIDTH - 1;++i)
+        context->tokenIds[i] = NOTYPE;
+    delete [] frequencyOrder;
+    delete [] firstPosition;
+    delete [] positions;
+    delete [] context->theBigIndex;
+    context->theBigIndex = NULL;
+    delete [] context->textBuffer;
+    context->textBuffer = NULL;
+
+    delete [] context->pindex;
+    context->pindex = NULL;
+    computeTypeStatistics();
+    }
 
-    delete [] pindex;
-    pindex = NULL;
+static void ReadTexts(const char ** sis)
+    {
+    int nofiles;
+    EndAnalysis();
+    for(nofiles = 0;sis[nofiles];++nofiles)
+        ;
+    textInput * texts = new textInput[nofiles];
+    for(int fileno = 0;fileno < nofiles;++fileno)
+        {
+        if(!readFile(sis[fileno],texts[fileno]))
+            {
+            fprintf(stderr,"Cannot open %s for reading\n",sis[fileno]);
+            exit(-13);
+            }
+        }
+    TokenizeTexts(texts,nofiles);
+    delete [] texts;
+    }
+
+static void ReadTexts(const textInput * texts,int ntexts)
+    {
+    EndAnalysis();
+    TokenizeTexts(texts,ntexts);
     }
 
 static void escap_fill(void)
@@ -2611,7 +4417,7 @@ for (int ikar = 0; ikar < 256 ; ikar++)
         case '\t' :
         case '\v' :
         case '\\' :
-            character[ikar] = ignored_symbol;
+            context->character[ikar] = ignored_symbol;
             break;
         }
 }
@@ -2619,18 +4425,18 @@ for (int ikar = 0; ikar < 256 ; ikar++)
 static void atomic_string_fill(void)
 {
 for (int ikar = 0; ikar < 256 ; ikar++)
-    if(  character[ikar] != ignored_symbol
-      && character[ikar] != string_constituent
-      && character[ikar] != string_constituent_to_be_replaced
-      && character[ikar] != token_delimiter
-      && character[ikar] != sentence_delimiter
+    if(  context->character[ikar] != ignored_symbol
+      && context->character[ikar] != string_constituent
+      && context->character[ikar] != string_constituent_to_be_replaced
+      && context->character[ikar] != token_delimiter
+      && context->character[ikar] != sentence_delimiter
 #ifdef UNNECESSARYSTUFF
-      && character[ikar] != control_character_to_be_kept
-      && character[ikar] != character_only_occurring_at_start_of_string
-      && character[ikar] != character_only_occurring_at_end_of_string
+      && context->character[ikar] != control_character_to_be_kept
+      && context->character[ikar] != character_only_occurring_at_start_of_string
+      && context->character[ikar] != character_only_occurring_at_end_of_string
 #endif
       )
-        character[ikar] = atomic_string;
+        context->character[ikar] = atomic_string;
 }
 
 
@@ -2639,12 +4445,12 @@ static void ignored_symbol_fill(void)
 for (int ikar = 0; ikar < 256 ; ikar++)
     if (ikar < ' '
 #ifdef UNNECESSARYSTUFF
-    && character[ikar] != control_character_to_be_kept
+    && context->character[ikar] != control_character_to_be_kept
 #else
-    && character[ikar] != atomic_string
+    && context->character[ikar] != atomic_string
 #endif
     )
-        character[ikar] = ignored_symbol;
+        context->character[ikar] = ignored_symbol;
 }
 
 
@@ -2700,33 +4506,33 @@ for (int ikar = 0; ikar < 256 ; ikar++)
         (ikar >= 192))
 #endif
 #endif
-        character[ikar] = string_constituent;
-character[(unsigned int)'&'] = string_constituent;
-character[(unsigned int)'\''] = string_constituent;
-character[(unsigned int)'*'] = string_constituent;
-character[(unsigned int)'+'] = string_constituent;
-character[(unsigned int)'-'] = string_constituent;
-character[(unsigned int)'/'] = string_constituent;
-character[(unsigned int)'<'] = string_constituent;
-character[(unsigned int)'>'] = string_constituent;
-character[(unsigned int)'_'] = string_constituent;
-character[(unsigned int)'\\'] = string_constituent;
+        context->character[ikar] = string_constituent;
+context->character[(unsigned int)'&'] = string_constituent;
+context->character[(unsigned int)'\''] = string_constituent;
+context->character[(unsigned int)'*'] = string_constituent;
+context->character[(unsigned int)'+'] = string_constituent;
+context->character[(unsigned int)'-'] = string_constituent;
+context->character[(unsigned int)'/'] = string_constituent;
+context->character[(unsigned int)'<'] = string_constituent;
+context->character[(unsigned int)'>'] = string_constituent;
+context->character[(unsigned int)'_'] = string_constituent;
+context->character[(unsigned int)'\\'] = string_constituent;
 }
 
 static void token_delimiter_fill(void)
 {
-character[(unsigned int)'\0'] = token_delimiter;
-character[(unsigned int)' '] = token_delimiter;
-character[(unsigned int)'\n'] = token_delimiter;
-character[(unsigned int)'\t'] = token_delimiter;
+context->character[(unsigned int)'\0'] = token_delimiter;
+context->character[(unsigned int)' '] = token_delimiter;
+context->character[(unsigned int)'\n'] = token_delimiter;
+context->character[(unsigned int)'\t'] = token_delimiter;
 }
 
 static void sentence_delimiter_fill(void)
 {
-character[(unsigned int)'.'] = sentence_delimiter;
-character[(unsigned int)'!'] = sentence_delimiter;
-character[(unsigned int)'?'] = sentence_delimiter;
-character[(unsigned int)';'] = sentence_delimiter;
+context->character[(unsigned int)'.'] = sentence_delimiter;
+context->character[(unsigned int)'!'] = sentence_delimiter;
+context->character[(unsigned int)'?'] = sentence_delimiter;
+context->character[(unsigned int)';'] = sentence_delimiter;
 }
 
 
@@ -2735,9 +4541,9 @@ void fill_character_properties(void)
     {
     for(int i = 0;i < 256;i++)
         {
-        character[i] = atomic_string;
+        context->character[i] = atomic_string;
 //        replacement_for_string_constituent[i] = '\n';
-        replacement_for_string_constituent[i] = '\0';
+        context->replacement_for_string_constituent[i] = '\0';
         }
     string_constituent_fill();
     escap_fill();
@@ -2754,9 +4560,9 @@ void fill_character_properties(void)
 
 void ShiftToNextProp(int i)
     {
-    character[i] = (charprop)((int)character[i] + 1);
-    if(character[i] == lastcharprop)
-        character[i] = (charprop)((int)firstcharprop + 1);
+    context->character[i] = (charprop)((int)context->character[i] + 1);
+    if(context->character[i] == lastcharprop)
+        context->character[i] = (charprop)((int)firstcharprop + 1);
     }
 
 void phrase::print(FILE * fp)
@@ -2844,744 +4650,355 @@ bool phrase::stat(unsigned long phraseno,leastSquareFitter * line)
         double x = log((double)phraseno);
         line->add(x,length);
 #ifdef __BORLANDC__
-        addXY(x,length,0);
-#endif
-        return true;
-        }
-    return false;
-    }
-//#endif
-
-void phrase::setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency()
-    { // Phrase Frequency * SUM("wavelength"), where wavelength=average distance between occurrences of word=inverse of frequency
-    double av = 0.0;
-    unsigned long i;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        av += 1.0/wording[i].tp->getFrequency();
-    weight = av * count;
-    if(next)
-        next->setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
-    }
-
-void phrase::setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency()
-    { // Phrase Frequency * phrase length * PRODUCT("wavelength"/meanwavelength), where wavelength=average distance between occurrences of word=inverse of frequency
-    double prod = 1.0;
-    unsigned long i;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        if(wording[i].tp->isWord())
-            prod *= averageTypeFrequency/wording[i].tp->getFrequency();
-        }
-    weight = prod * count * length;
-    if(next)
-        next->setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency();
-    }
-
-/*
-static double entropy(word * wording,unsigned long length)
-    {
-    unsigned long i;
-    double S = 0.0;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        double freq = wording[i].tp->getFrequency();
-        S += freq * log(freq);
-        }
-    return S;
-    }
-*/
-
-void phrase::setWeightAsFrequencyTimesLengthTimesAverageOfEntropy()
-    {
-    double av = 0.0;
-    unsigned long i;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        double freq = wording[i].tp->getFrequency();
-        double prob = 1.0/freq;
-        av -= prob * log(prob);
-        }
-    weight = av * count;
-    if(next)
-        next->setWeightAsFrequencyTimesLengthTimesAverageOfEntropy();
-    }
-
-void phrase::setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength()
-    {
-    double av = 0.0;
-    unsigned long i;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        double freq = wording[i].tp->getFrequency();
-        double prob = 1.0/freq;
-        av -= prob * log((double)prob);
-        }
-    weight = av * count * log((double)length);
-    if(next)
-        next->setWeightAsFrequencyTimesLengthTimesAverageOfEntropy();
-    }
-/*
-void phrase::setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction()
-    {
-    double av = 0.0;
-    unsigned long i;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        double freq = wording[i].tp->getFrequency();
-        double prob = 1.0/freq;
-        av -= prob * log(prob);
-        }
-    weight = av * realCount * log(length); // count * (realCount/count) = realCount
-    if(next)
-        next->setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction();
-    }
-*/
-
-void phrase::setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction()
-    {
-    double av = 0.0;
-    unsigned long i;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        av += 1.0/wording[i].tp->getFrequency();
-    weight = av * realCount; // count * (realCount/count) = realCount
-    if(next)
-        next->setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction();
-    }
-
-double LogFac(unsigned long realCount)
-    {
-    double sum;
-    if(realCount < sizeof(logfac)/sizeof(logfac[0]))
-        {
-        sum = logfac[realCount];
-        }
-    else
-        {
-        sum = logfac[sizeof(logfac)/sizeof(logfac[0])-1];
-        unsigned long i;
-        for ( i = sizeof(logfac)/sizeof(logfac[0])
-            ; i <= realCount
-            ; ++i
-            )
-            sum += log(double(i));
-        }
-    return sum;
-    }
-
-
-#if 1
-void phrase::setWeight2005()
-    {
-    double sum = 0.0;
-    double Sum = 0.0;
-    unsigned long i;
-    unsigned long j;
-/*
-x  = type
- i
-
-n = number of words in text
-m = number of repetitions of phrase
-
-x ... x  = a sequence of l types x ... x  ('phrase')
- 1     l                          1     l
-               l
-p(x ...x ) = PROD p(x )
-   1    l     i=1    i
-
- m
-P (x ...x ) = Probability that phrase x ...x  occurs m times in a text with length n
- n  1    l                             1    l
-                m
-              PROD (n - jl + 1)
-              j=1                            m                  n - ml
-            = ----------------- (p(x ... x ))  (1 - p(x ... x ))
-                     m!             1     l            1     l
-
-
-       m                         m
-  log P (x ... x ) = - log m! + SUM log(n-jl+1) + m log p(x ...x ) + (n - ml) log (1 - p(x ...x ))
-       n  1     l               j=1                        1    l                         1    l
-
-*/
-
-
-/*
-    -log m!
-*/
-    sum = -LogFac(realCount);
-
-    Sum += sum;
-
-/*
-     m
-    SUM log(n-jl+1)
-    j=1
-*/
-
-    sum = 0.0;
-
-    for ( j = 1
-        ; j <= realCount
-        ; ++j
-        )
-        {
-        if(tokens - j*length + 1 > 0)
-            {
-            sum += log((double)(tokens - j*length + 1));
-            }
-        }
-
-    Sum += sum;
-
-/*
-    m log p(x ... x )
-             1     l
-*/
-    sum = 0.0;
-
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        if(wording[i].tp->getFrequency() > 0)
-            {
-            sum += log((double)(wording[i].tp->getFrequency()));
-            }
-        else
-            sum = 0;
-        }
-    if(tokens > 0)
-        {
-        sum = realCount * (sum - length * log((double)tokens));
-        }
-    else
-        sum = 0;
-
-    Sum += sum;
-
-/*
-(n - ml) log (1 - p(x ...x ))
-                     1    l
-
-*/
-    sum = 0.0;
-
-    double prod = 1.0;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        if(wording[i].tp->getFrequency() > 0)
-            {
-            prod *= (double)(wording[i].tp->getFrequency())/(double)tokens;
-            }
-        else
-            {
-            prod = 0.0;
-            break;
-            }
-        }
-
-    if(prod < 1.0)
-        {
-        sum += (tokens - realCount*length)*log(1.0 - prod);
-        }
-    else
-        sum = 0;
-
-    Sum += sum;
-
-    weight = -Sum;
-    if(next)
-        next->setWeight2005();
-    }
-#else
-// Same function, but with count instead of realCount.
-void phrase::setWeight2005()
-    {
-    double sum = 0.0;
-    double Sum = 0.0;
-    unsigned long i;
-    unsigned long j;
-/*
-x  = type
- i
-
-n = number of words in text
-m = number of repetitions of phrase
-
-x ... x  = a sequence of l types x ... x  ('phrase')
- 1     l                          1     l
-               l
-p(x ...x ) = PROD p(x )
-   1    l     i=1    i
-
- m
-P (x ...x ) = Probability that phrase x ...x  occurs m times in a text with length n
- n  1    l                             1    l
-                m
-              PROD (n - jl + 1)
-              j=1                            m                  n - ml
-            = ----------------- (p(x ... x ))  (1 - p(x ... x ))
-                     m!             1     l            1     l
-
-
-       m                         m
-  log P (x ... x ) = - log m! + SUM log(n-jl+1) + m log p(x ...x ) + (n - ml) log (1 - p(x ...x ))
-       n  1     l               j=1                        1    l                         1    l
-
-*/
-
-
-/*
-    -log m!
-*/
-    if(count <= sizeof(logfac))
-        sum = -logfac[count-1];
-    else
-        {
-        sum = -logfac[sizeof(logfac)-1];
-        for ( i = sizeof(logfac)
-            ; i <= count
-            ; ++i
-            )
-            sum -= log(double(i));
-        }
-
-    Sum += sum;
-/*
-     m
-    SUM log(n-jl+1)
-    j=1
-*/
-
-    sum = 0.0;
-
-    for ( j = 1
-        ; j <= count
-        ; ++j
-        )
-        {
-        if(tokens - j*length + 1 > 0)
-            {
-            sum += log(tokens - j*length + 1);
-            }
-        }
-
-    Sum += sum;
-
-/*
-    m log p(x ... x )
-             1     l
-*/
-    sum = 0.0;
-
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        if(wording[i].tp->getFrequency() > 0)
-            {
-            sum += log(wording[i].tp->getFrequency());
-            }
-        else
-            sum = 0;
-        }
-    if(tokens > 0)
-        {
-        sum = count * (sum - length * log((double)tokens));
-        }
-    else
-        sum = 0;
-
-    Sum += sum;
-
-/*
-(n - ml) log (1 - p(x ...x ))
-                     1    l
-
-*/
-    sum = 0.0;
-
-    double prod = 1.0;
-    for ( i = 0
-        ; i < length
-        ; ++i
-        )
-        {
-        if(wording[i].tp->getFrequency() > 0)
-            {
-            prod *= (double)(wording[i].tp->getFrequency())/(double)tokens;
-            }
-        else
-            {
-            prod = 0.0;
-            break;
-            }
-        }
-
-    if(prod < 1.0)
-        {
-        sum += (tokens - count*length)*log(1.0 - prod);
+        addXY(x,length,0);
+#endif
+        return true;
         }
-    else
-        sum = 0;
-
-    Sum += sum;
-
-    weight = -Sum; // count * (realCount/count) = realCount
-    if(next)
-        next->setWeight2005();
+    return false;
     }
-#endif
+//#endif
 
-// This weight function decrements a word's frequency each time the word occurs
-// in a sequence. The probability that a sequence occurs more often than any
-// of its words thereby becomes zero. In the previous weight function the word
-// probabilities are fixed and there is a non-zero probability that a sequence
-// occurs more often than any of its words.
-// There are some differences in the order of the phrases, but they are not that
-// big.
-void phrase::setWeight2005b()
+unsigned long phrase::countOccurrences(const fuzzyness * F)
     {
-    double Sum = 0.0;
-    unsigned long i;
-    unsigned long j;
-
-    double prod = 1.0;
-    for(j = 1; j <= realCount;++j)
-        {
-        prod = 1.0;
-        Sum += log((double)(tokens - j * length + 1));
-        for ( i = 0
-            ; i < length
-            ; ++i
+    unsigned long count = 0;
+    size_t at = wording - context->words1;
+    for(postingBlocks block(wording[offset].tp);block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end()
+            ; q++
             )
             {
-            if(wording[i].tp->getFrequency() > j - 1)
+            ptrdiff_t first = (ptrdiff_t)*q - offset;
+            prefetchCandidate(q,block.end(),offset,NULL);
+            if  (  first >= 0 // candidates can not start before begin of text
+                && first + length <= context->tokens
+                                // candidates can not end after end of text
+                && goodSize(F,context->words1 + first,length,context->words1,context->afterlastword )
+                )
                 {
-                Sum += log((double)(wording[i].tp->getFrequency() - j + 1));
-                if(wording[i].tp->getFrequency() > j)
+                if(samePhrase(first,at,length,NULL))
                     {
-                    prod *= (wording[i].tp->getFrequency() - j)/tokens;
+                    ++count;
                     }
                 }
             }
-        if(1.0 - prod > 0)
-            Sum += (tokens - j * length) * log(1.0 - prod);
-  //      else
-    //        break;
-        }
-
-    Sum -= length * realCount * log((double)tokens);
-
-    Sum -= LogFac(realCount);
-
-    weight = -Sum;
-    if(next)
-        next->setWeight2005b();
+    setCount(count);
+    return count;
     }
 
-
-unsigned long phrase::countPhrase(word * words, bool recount)
+unsigned long phrase::countPhrase(ranking * R, bool recount)
     {
+    char * marked = R->marked;
     word * firstMarked = NULL, * lastMarked = NULL;
     if(recount)
         realCount = 0;
-    word * const * index = wording[offset].tp->getIndex();
-    const unsigned long frequency = wording[offset].tp->getFrequency();
-    for ( word * const * q = index
-        ; q < index + frequency
-        ; q++
-        )
-        {
-        word * cand = *q - offset;
-        if  (  cand >= words // candidates can not start before begin of text
-            && cand + length <= afterlastword
-                            // candidates can not end after end of text
-            && goodSize(cand,length,words/*firstOfText*/,afterlastword /*firstOfNextText*/)
+    size_t at = wording - context->words1;
+    for(postingBlocks block(wording[offset].tp);block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end()
+            ; q++
             )
             {
-            word * r, * s;
-            for ( r = cand, s = wording
-                ;    s < wording + length
-                  && r->marked == _f_
-                  && r->tp == s->tp
-                  && s->tp != NULL
-                ; ++r,++s
+            ptrdiff_t first = (ptrdiff_t)*q - offset;
+            prefetchCandidate(q,block.end(),offset,marked);
+            if  (  first >= 0 // candidates can not start before begin of text
+                && first + length <= context->tokens
+                                // candidates can not end after end of text
+                && goodSize(&R->fuzzy,context->words1 + first,length,context->words1/*firstOfText*/,context->afterlastword /*firstOfNextText*/)
                 )
-                ;
-            if(s == wording+length)
-                {
-                firstMarked = cand;
-                lastMarked = cand + length - 1;
-                firstMarked->marked = _b_; // begin
-                for ( r = firstMarked + 1
-                    ; r < lastMarked
-                    ; ++r
-                    )
-                    r->marked = _t_;
-                lastMarked->marked |= _e_; // end
-                if(recount)
-                    ++realCount;
+                {
+                word * r;
+                if(samePhrase(first,at,length,marked))
+                    {
+                    firstMarked = context->words1 + first;
+                    lastMarked = firstMarked + length - 1;
+                    marked[firstMarked - context->words1] = _b_; // begin
+                    for ( r = firstMarked + 1
+                        ; r < lastMarked
+                        ; ++r
+                        )
+                        marked[r - context->words1] = _t_;
+                    marked[lastMarked - context->words1] |= _e_; // end
+                    if(recount)
+                        ++realCount;
+                    }
                 }
             }
-        }
     if(realCount == 1)
         {                       // one occurrence is NO repetition.
         for ( word * r = firstMarked
             ; r <= lastMarked
             ; ++r
             )
-            r->marked = _f_;
+            marked[r - context->words1] = _f_;
         realCount = 0L;
         }
     return realCount;
     }
 
-unsigned long phrase::countPhraseInText(/*word * words, */bool recount,
+unsigned long phrase::countPhraseInText(ranking * R, bool recount,
         word * textFirst, word * nextTextFirst)
     {
+    char * marked = R->marked;
     word * firstMarked /*= NULL*/, * lastMarked/* = NULL*/;
     unsigned long lRealCount;
     if(recount)
         realCount = 0;
     lRealCount = 0;
-    word * const * index = wording[offset].tp->getIndex();
-    const unsigned long frequency = wording[offset].tp->getFrequency();
-    for ( word * const * q = index
-        ; q < index + frequency
-        ; q++
-        ) // traverse all occurrences of this phrase
-        {
-        word * cand = *q - offset;
-        if  (  cand >= textFirst // candidates can not start before begin of text
-            && cand + length <= nextTextFirst
-                            // candidates can not end after end of text
-            && goodSize(cand,length,textFirst,nextTextFirst)
-            )
+    size_t at = wording - context->words1;
+    ptrdiff_t from = textFirst - context->words1;
+    ptrdiff_t to = nextTextFirst - context->words1;
+    for(postingBlocks block(wording[offset].tp);block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end()
+            ; q++
+            ) // traverse all occurrences of this phrase
             {
-            word * r, * s;
-//            LOG("%ld---%ld",textFirst, nextTextFirst);
-            for ( r = cand, s = wording
-                ;    s < wording + length
-                  && (/*LOG("%d %c %s",r,marked[r],words[r]->name())
-                     ,*/r->marked == _f_
-                     )
-                  && r->tp == s->tp
-                  && s->tp != NULL
-                ; ++r,++s
+            ptrdiff_t first = (ptrdiff_t)*q - offset;
+            prefetchCandidate(q,block.end(),offset,marked);
+            if  (  first >= from // candidates can not start before begin of text
+                && first + (ptrdiff_t)length <= to
+                                // candidates can not end after end of text
+                && goodSize(&R->fuzzy,context->words1 + first,length,textFirst,nextTextFirst)
                 )
-                ;
-            if(s == wording + length)
-                {
-                firstMarked = cand;
-                lastMarked = cand + length - 1;
-//                LOG("MARK! firstMarked %d lastMarked %d",firstMarked,lastMarked);
-                firstMarked->marked = _B_; // begin
-                for ( r = firstMarked + 1
-                    ; r < lastMarked
-                    ; ++r
-                    )
-                    r->marked = _t_;
-                lastMarked->marked |= _e_; // end
-                ++realCount;
-                ++lRealCount;
+                {
+                word * r;
+    //            LOG("%ld---%ld",textFirst, nextTextFirst);
+                if(samePhrase(first,at,length,marked))
+                    {
+                    firstMarked = context->words1 + first;
+                    lastMarked = firstMarked + length - 1;
+    //                LOG("MARK! firstMarked %d lastMarked %d",firstMarked,lastMarked);
+                    marked[firstMarked - context->words1] = _B_; // begin
+                    for ( r = firstMarked + 1
+                        ; r < lastMarked
+                        ; ++r
+                        )
+                        marked[r - context->words1] = _t_;
+                    marked[lastMarked - context->words1] |= _e_; // end
+                    ++realCount;
+                    ++lRealCount;
+                    }
+    /*            else
+                    LOG("NOmark");*/
                 }
-/*            else
-                LOG("NOmark");*/
             }
-        }
 //  LOG("realCount %d",realCount);
     return lRealCount;
     }
 
-void phrase::confirmPhraseInText(word * textFirst, word * nextTextFirst)
+void phrase::confirmPhraseInText(ranking * R, word * textFirst, word * nextTextFirst)
     {
-    word * firstMarked/* = NULL*/;
-    word * const * index = wording[offset].tp->getIndex();
-    const unsigned long frequency = wording[offset].tp->getFrequency();
-    for ( word * const * q = index
-        ; q < index + frequency
-        ; q++
-        ) // traverse all occurrences of this phrase
-        {
-        word * cand = *q - offset;
-        if  (  cand >= textFirst // candidates can not start before begin of text
-            && cand + length <= nextTextFirst
-                            // candidates can not end after end of text
+    char * marked = R->marked;
+    ptrdiff_t from = textFirst - context->words1;
+    ptrdiff_t to = nextTextFirst - context->words1;
+    for(postingBlocks block(wording[offset].tp);block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end()
+            ; q++
+            ) // traverse all occurrences of this phrase
+            {
+            ptrdiff_t first = (ptrdiff_t)*q - offset;
+            if  (  first >= from // candidates can not start before begin of text
+                && first + (ptrdiff_t)length <= to
+                                // candidates can not end after end of text
+                )
+                {
+                if(marked[first] & _B_)
+                    {
+                    marked[first] &= ~_B_;
+                    marked[first] |= _b_;
+                    }
+                }
+            }
+    }
+
+/* Sets rankAt[] of the first word of each marked span that is an occurrence of
+this phrase, unless a higher ranked phrase already did. */
+void phrase::rankOccurrences(const char * marked,uint32_t * rankAt,uint32_t rank)
+    {
+    size_t at = wording - context->words1;
+    for(postingBlocks block(wording[offset].tp);block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end()
+            ; q++
             )
             {
-            firstMarked = cand;
-            if(firstMarked->marked & _B_)
+            ptrdiff_t start = (ptrdiff_t)*q - offset;
+            if  (  start >= 0
+                && start + length <= context->tokens
+                )
                 {
-                firstMarked->marked &= ~_B_;
-                firstMarked->marked |= _b_;
+                size_t first = start;
+                size_t last = first + length - 1;
+                if(  rankAt[first]
+                  || !(marked[first] & _b_)
+                  || !(marked[last] & _e_)
+                  || !samePhrase(first,at,length,NULL)
+                  )
+                    continue;
+                size_t i;
+                for ( i = 1 // no other occurrence begins or ends inside
+                    ;    i < length
+                      && !(marked[first + i] & _b_)
+                      && !(marked[first + i - 1] & _e_)
+                    ; ++i
+                    )
+                    ;
+                if(i == length)
+                    rankAt[first] = rank;
                 }
             }
-        }
     }
 
-unsigned long phrase::uncountPhraseInText(/*word * words,*/
+unsigned long phrase::uncountPhraseInText(ranking * R,
         word * textFirst, word * nextTextFirst)
     {
+    char * marked = R->marked;
     word * firstMarked /*= NULL*/, * lastMarked/* = NULL*/;
     unsigned long lRealCount;
     lRealCount = 0;
-    word * const * index = wording[offset].tp->getIndex();
-    const unsigned long frequency = wording[offset].tp->getFrequency();
-    for ( word * const * q = index
-        ; q < index + frequency
-        ; q++
-        )
-        {
-        word * cand = *q - offset;
-        if  (  cand >= textFirst // candidates can not start before begin of text
-            && cand + length <= nextTextFirst
-                            // candidates can not end after end of text
+    ptrdiff_t from = textFirst - context->words1;
+    ptrdiff_t to = nextTextFirst - context->words1;
+    for(postingBlocks block(wording[offset].tp);block.next();)
+        for ( const uint32_t * q = block.begin()
+            ; q < block.end()
+            ; q++
             )
             {
-            word * r, * s;
-            firstMarked = cand;
-            lastMarked = cand + length - 1;
-//          LOG("firstMarked %d lastMarked %d",firstMarked,lastMarked);
-            if(  firstMarked->marked & _B_
-              && lastMarked->marked & _e_
-              )
-                {
-//              LOG("Be");
-                for ( r = firstMarked + 1, s = wording + 1
-                    ;    r < lastMarked
-                      && (r->marked & _t_)
-                      && r->tp == s->tp
-                      && s->tp != NULL
-                    ; ++r,++s
-                    )
-                    ;
-                }
-            else
-                {
-//              LOG("%c%c",marked[firstMarked],marked[lastMarked]);
-                r = NULL;
-                }
-//          LOG("r %d lastMarked %d",r,lastMarked);
-            if(r >= lastMarked)
+            ptrdiff_t first = (ptrdiff_t)*q - offset;
+            if  (  first >= from // candidates can not start before begin of text
+                && first + (ptrdiff_t)length <= to
+                                // candidates can not end after end of text
+                )
                 {
-                for ( r = firstMarked
-                    ; r <= lastMarked
-                    ; ++r
-                    )
-                    r->marked = _f_;
-                --realCount;
-                ++lRealCount;
+                word * r, * s;
+                firstMarked = context->words1 + first;
+                lastMarked = firstMarked + length - 1;
+    //          LOG("firstMarked %d lastMarked %d",firstMarked,lastMarked);
+                if(  marked[firstMarked - context->words1] & _B_
+                  && marked[lastMarked - context->words1] & _e_
+                  )
+                    {
+    //              LOG("Be");
+                    for ( r = firstMarked + 1, s = wording + 1
+                        ;    r < lastMarked
+                          && (marked[r - context->words1] & _t_)
+                          && r->tp == s->tp
+                          && s->tp != NULL
+                        ; ++r,++s
+                        )
+                        ;
+                    }
+                else
+                    {
+    //              LOG("%c%c",marked[firstMarked],marked[lastMarked]);
+                    r = NULL;
+                    }
+    //          LOG("r %d lastMarked %d",r,lastMarked);
+                if(r >= lastMarked)
+                    {
+                    for ( r = firstMarked
+                        ; r <= lastMarked
+                        ; ++r
+                        )
+                        marked[r - context->words1] = _f_;
+                    --realCount;
+                    ++lRealCount;
+                    }
                 }
             }
-        }
 //  LOG("undo realCount %d",realCount);
     return lRealCount;
     }
 
-static int FuzzynessBoundary = 0;
-
 int currentFuzzynessBoundary()
     {
-    return FuzzynessBoundary;
+    return context->Fuzzyness.boundary;
     }
 
 void selectFuzzynessBoundary(int perc)
     {
-    FuzzynessBoundary = perc;
-    switch(perc)
+    context->Fuzzyness = fuzzynessLevel(perc);
+    context->numberOfRequestedLevels = 0;
+    }
+
+int chooseFuzzynessBoundaries(const char * list)
+    {
+    int n = 0;
+    while(*list)
         {
-        case 100:
-            FindReps = FindRepsAsSentence;
-            goodSize = goodSentenceSize;
-            break;
-        case 0:
-            FindReps = FindRepsWithinSentence;
-            goodSize = goodAllPhraseSize;
-            break;
-        default:
-            FindReps = FindRepsWithinSentence;
-            goodSize = goodPhraseSize;
-            MaxUncovered = (100.0/(double)perc) - 1.0;
+        char * end;
+        long perc = strtol(list,&end,10);
+        if(end == list)
             break;
-        }
+        if(0 <= perc && perc <= 100 && n < MAXFUZZYLEVELS)
+            {
+            int j;
+            for(j = 0;j < n && context->requestedLevels[j].boundary != perc;++j)
+                ;
+            if(j == n)
+                context->requestedLevels[n++] = fuzzynessLevel((int)perc);
+            }
+        list = end;
+        if(*list == ',')
+            ++list;
+        }
+    if(n == 1)
+        selectFuzzynessBoundary(context->requestedLevels[0].boundary);
+    else if(n > 1)
+        context->numberOfRequestedLevels = n;
+    return n;
     }
 
 
 unsigned long GetLowestfreq()
     {
-    return lowestfreq;
+    return context->lowestfreq;
     }
 
 unsigned long GetHighestfreq()
     {
-    return highestfreq;
+    return context->highestfreq;
     }
 
 ptrdiff_t GetNumberOfTokens()
     {
-    return (afterlastword - words1) - numberOfSentenceSeparators;
+    return (context->afterlastword - context->words1) - context->numberOfSentenceSeparators;
     }
 
 ptrdiff_t GetNumberOfTokensFile(int fileno)
     {
-    return filedatalist[fileno+1].boundary - filedatalist[fileno].boundary;
+    return context->filedatalist[fileno+1].boundary - context->filedatalist[fileno].boundary;
     }
 
 unsigned long GetNumberOfSentenceSeparatorsFile(int fileno)
     {
-    return filedatalist[fileno].numberOfSentenceSeparators;
+    return context->filedatalist[fileno].numberOfSentenceSeparators;
     }
 
 unsigned long GetRealUnmatchedFile(int fileno)
     {
-    return filedatalist[fileno].realUnmatched;
+    return context->rankings ? context->rankings[context->shownRanking].realUnmatchedFile[fileno] : 0L;
     }
 
 unsigned long GetNumberOfTypes()
     {
-    return types;
+    return context->types;
     }
 
 unsigned long GetLowestfreq(const char ** Type)
     {
     if(Type)
-        *Type = typeArray[lowtype].name();
-    return lowestfreq;
+        *Type = context->typeArray[context->lowtype].name();
+    return context->lowestfreq;
     }
 
 unsigned long GetHighestfreq(const char ** Type)
     {
     if(Type)
-        *Type = typeArray[hightype].name();
-    return highestfreq;
+        *Type = context->typeArray[context->hightype].name();
+    return context->highestfreq;
     }
 
 /*
@@ -3593,21 +5010,116 @@ static unsigned long GetNumberOfUnmatchedWords()
 
 size_t GetFiducialTextLength()
     {
-    return fiducialTextLength;
+    return context->rankings ? context->rankings[context->shownRanking].fiducialTextLength : 0L;
     }
 
 size_t GetReducedTextLength()
     {
-    return reducedTextLength;
+    return context->rankings ? context->rankings[context->shownRanking].reducedTextLength : 0L;
     }
 
 unsigned long GetRealUnmatched()
     {
-    return realUnmatched;
+    return context->rankings ? context->rankings[context->shownRanking].realUnmatched : 0L;
+    }
+
+unsigned long GetRepeatedPhrase(unsigned long rank,char * words,size_t size)
+    {
+    if(!context->rankings)
+        return 0L;
+    const ranking * R = context->rankings + context->shownRanking;
+    for(unsigned long p = 0;p < R->numberOfPhrases;++p)
+        {
+        const phrase * Phrase = R->phrases[p];
+        if(Phrase->RealCount() > 1 && rank-- == 0)
+            {
+            size_t len = 0;
+            if(size > 0)
+                words[0] = '\0';
+            for(size_t i = 0;i < Phrase->Length() && len + 1 < size;++i)
+                {
+                int n = snprintf(words + len,size - len,i ? " %s" : "%s",Phrase->Wording()[i].tp->name());
+                len = n < 0 || (size_t)n >= size - len ? size - 1 : len + n;
+                }
+            return Phrase->RealCount();
+            }
+        }
+    return 0L;
+    }
+
+/* Finds, counts and ranks the repeated phrases in the texts that were read. */
+static double RankTexts(double * versionalikeness)
+    {
+    int numberOfLevels = context->numberOfRequestedLevels > 1 ? context->numberOfRequestedLevels : 1;
+    const fuzzyness * levels = context->numberOfRequestedLevels > 1 ? context->requestedLevels : &context->Fuzzyness;
+    int numberOfWeights = context->numberOfRequestedWeights > 1 ? context->numberOfRequestedWeights : 1;
+    void (**weights)(ranking * R,phrasekey * keys) = context->numberOfRequestedWeights > 1 ? context->requestedWeights : &context->setWeight;
+    context->numberOfRankings = numberOfLevels * numberOfWeights;
+    context->numberOfRankedLevels = numberOfLevels;
+    context->rankings = context->memory.newArray<ranking>(context->numberOfRankings);
+    for(int l = 0;l < numberOfLevels;++l)
+        {
+        // Levels other than 100 (sentence) find the same phrases, but count
+        // different occurrences of them.
+        discovery * D;
+        for ( D = context->discoveries
+            ; D < context->discoveries + context->numberOfDiscoveries && D->FindReps != levels[l].FindReps
+            ; ++D
+            )
+            ;
+        bool found = D < context->discoveries + context->numberOfDiscoveries;
+        if(!found)
+            {
+            D->FindReps = levels[l].FindReps;
+            ++context->numberOfDiscoveries;
+            Repetitions(D);
+            }
+        ranking * R = context->rankings + l * numberOfWeights;
+        R->init(weights[0],levels[l],D->records,D->numberOfPhrases,found);
+        CountRepetitions(R);
+        for(int w = 1;w < numberOfWeights;++w)
+            R[w].init(weights[w],levels[l],R->records,R->numberOfPhrases,true);
+        }
+//    setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
+//    setWeightAsFrequencyTimesLengthTimesAverageOfEntropy();
+//    if(setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction>)
+    // The rankings are independent. Each one weighs, sorts and recounts its
+    // own copy of the phrases.
+    parallelForAnalysis(context->numberOfRankings,1,[](unsigned long first,unsigned long last)
+        {
+        for(unsigned long r = first;r < last;++r)
+            RankPhrases(context->rankings + r);
+        });
+    context->shownRanking = 0;
+#if 0
+    if(context->setWeight == weighPhrases<weightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction>)
+        {
+        setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
+        SortPhrases();
+        for(int i = 0;i < 1;++i) // The weights change as a result of sorting and count reduction.
+                            // One might repeat this step a few times, to attain a "stable" order.
+            {
+            context->setWeight();
+            SortPhrases();
+            }
+        }
+    else
+        {
+        context->setWeight();
+        SortPhrases();
+        }
+#endif
+//    WriteResults();
+    int fileno;
+    if(versionalikeness)
+        for(fileno = 0;fileno < context->numberOfFiles;fileno++)
+            versionalikeness[fileno] = context->rankings[context->shownRanking].alikeness[fileno];
+    return context->rankings[context->shownRanking].repetitiveness;
     }
 
 double ComputeRepetitiveness(const char ** sis, double * versionalikeness,bool morphemes)
     {
+    context->morphemes = morphemes;
     ReadTexts(sis);
     unsigned long i;
     if(morphemes)
@@ -3616,14 +5128,14 @@ double ComputeRepetitiveness(const char ** sis, double * versionalikeness,bool m
         const char * names[] = {"words.txt",NULL};
         fw = fopen(names[0],"wb");
         for ( i = 0
-            ; i < types
+            ; i < context->types
             ; ++i
             )
             {
-            const char * tp = typeArray[i].name();
+            const char * tp = context->typeArray[context->nameOrder[i]].name();
             int kar;
             fprintf(fw,"^ ");
-            while((kar = getUTF8char(tp,globUTF8)) != 0)
+            while((kar = getUTF8char(tp,context->UTF8)) != 0)
                 {
                 char let[7];
                 int len = UnicodeToUtf8(kar,let,sizeof(let)-1);
@@ -3643,63 +5155,124 @@ double ComputeRepetitiveness(const char ** sis, double * versionalikeness,bool m
     else
         {
         for ( i = 0
-            ; i < types
+            ; i < context->types
             ; ++i
             )
             {
-            const char * tp = typeArray[i].name();
-            while(globUTF8 && getUTF8char(tp,globUTF8) != 0)
+            const char * tp = context->typeArray[context->nameOrder[i]].name();
+            while(context->UTF8 && getUTF8char(tp,context->UTF8) != 0)
                 {
                 ;
                 }
-            if(!globUTF8)
+            if(!context->UTF8)
                 {
-                printf("%s\n",typeArray[i].name());
+                printf("%s\n",context->typeArray[context->nameOrder[i]].name());
                 getchar();
                 }
             }
         }
-    Repetitions();
-    CountRepetitions();
-//    setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
-//    setWeightAsFrequencyTimesLengthTimesAverageOfEntropy();
-//    if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction)
-    for(int i = 0; i < npasses; ++i)
-        {
-        setWeight();
-        SortPhrases();
-        }
-#if 0
-    if(setWeight == setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction)
-        {
-        setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency();
-        SortPhrases();
-        for(int i = 0;i < 1;++i) // The weights change as a result of sorting and count reduction.
-                            // One might repeat this step a few times, to attain a "stable" order.
-            {
-            setWeight();
-            SortPhrases();
-            }
-        }
-    else
-        {
-        setWeight();
-        SortPhrases();
-        }
-#endif
-//    WriteResults();
-    double rep = RepetitivenessBetter();
-    repetitiveness = rep;
-    int fileno;
-    if(versionalikeness)
-        for(fileno = 0;sis[fileno] != NULL;fileno++)
-            versionalikeness[fileno] = ReductionDueToPreviousVersion(fileno);
-    MarkRepeatedPhrases();
-//#ifdef __BORLANDC__
-    DrawGraph();
-//#endif
-    WriteTextWithMarkings();
-    return rep;
+    double repetitiveness = RankTexts(versionalikeness);
+    if(context->writeMarkedTexts)
+        DeleteMarkedFileNames(WriteTextWithMarkings());
+    return repetitiveness;
+    }
+
+double ComputeRepetitiveness(const textInput * texts,int ntexts,double * versionalikeness)
+    {
+    context->morphemes = false;
+    ReadTexts(texts,ntexts);
+    return RankTexts(versionalikeness);
+    }
+
+
+double ComputeRepetitiveness(analysis * A,const char ** sis,double * versionalikeness,bool morphemes)
+    {
+    analysisScope scope(A);
+    return ComputeRepetitiveness(sis,versionalikeness,morphemes);
+    }
+
+double ComputeRepetitiveness(analysis * A,const textInput * texts,int ntexts,double * versionalikeness)
+    {
+    analysisScope scope(A);
+    return ComputeRepetitiveness(texts,ntexts,versionalikeness);
+    }
+
+bool WriteTextWithMarkings(analysis * A,int fileno,FILE * fp)
+    {
+    analysisScope scope(A);
+    return WriteTextWithMarkings(fileno,fp);
+    }
+
+void EndAnalysis(analysis * A)
+    {
+    analysisScope scope(A);
+    EndAnalysis();
+    }
+
+int GetNumberOfRankings(analysis * A)
+    {
+    analysisScope scope(A);
+    return GetNumberOfRankings();
+    }
+
+unsigned long GetLowestfreq(analysis * A,const char ** Type)
+    {
+    analysisScope scope(A);
+    return GetLowestfreq(Type);
+    }
+
+unsigned long GetHighestfreq(analysis * A,const char ** Type)
+    {
+    analysisScope scope(A);
+    return GetHighestfreq(Type);
+    }
+
+ptrdiff_t GetNumberOfTokens(analysis * A)
+    {
+    analysisScope scope(A);
+    return GetNumberOfTokens();
+    }
+
+ptrdiff_t GetNumberOfTokensFile(analysis * A,int fileno)
+    {
+    analysisScope scope(A);
+    return GetNumberOfTokensFile(fileno);
+    }
+
+unsigned long GetNumberOfSentenceSeparatorsFile(analysis * A,int fileno)
+    {
+    analysisScope scope(A);
+    return GetNumberOfSentenceSeparatorsFile(fileno);
+    }
+
+unsigned long GetRealUnmatchedFile(analysis * A,int fileno)
+    {
+    analysisScope scope(A);
+    return GetRealUnmatchedFile(fileno);
+    }
+
+unsigned long GetNumberOfTypes(analysis * A)
+    {
+    analysisScope scope(A);
+    return GetNumberOfTypes();
+    }
+
+size_t GetFiducialTextLength(analysis * A)
+    {
+    analysisScope scope(A);
+    return GetFiducialTextLength();
+    }
+
+size_t GetReducedTextLength(analysis * A)
+    {
+    analysisScope scope(A);
+    return GetReducedTextLength();
+    }
+
+unsigned long GetRealUnmatched(analysis * A)
+    {
+    analysisScope scope(A);
+    return GetRealUnmatched();
     }
 
 #if !defined __BORLANDC__
@@ -3723,63 +5296,103 @@ int main(int argc, char ** argv)
         }
 
     fill_character_properties();
+    flagspreambule preambule;
+    preambule.allflags = 0;
+    preambule.bools.b_case_sensitive = true;
+    preambule.bools.b_formula = true;
+    preambule.bools.b_fuzzy = true;
+    preambule.bools.b_limit = true;
+    preambule.bools.b_passes = true;
+    preambule.bools.b_repetitiveness = true;
+    preambule.bools.b_task = true;
+    preambule.bools.b_weight = true;
 //    double versionalikeness = 0.0;
 //    printf("%s : %f\n",argv[1],ComputeRepetitiveness(argv+1,&versionalikeness));
     if(argc - optind > 1)
-        versioncomparison = true;
-    npasses = 2;
+        setVersionComparison(true);
+    setRecursion(2);
     if(options.p)
         {
         if(!strcmp(options.p,"1"))
-            npasses = 1;
+            setRecursion(1);
         }
     if(options.w)
+        chooseWeights(options.w);
+    if(options.f)
+        chooseFuzzynessBoundaries(options.f);
+    if(options.k)
+        setTopK(strtoul(options.k,NULL,10));
+    if(options.c)
+        setMarkedOutput(options.c);
+    if(options.z && !setCompression(options.z))
+        {
+        printf("Compression %s is unknown or not built in\n",options.z);
+        exit(-1);
+        }
+    compression method = context->markedCompression;
+    if(options.r)
+        return render(options.r,argv+optind,method);
+    const char * spanIndex = options.i;
+    bool binarySpanIndex = false;
+    if(spanIndex)
+        {
+        if(!strncmp(spanIndex,"binary,",7))
+            {
+            binarySpanIndex = true;
+            spanIndex += 7;
+            }
+        setWriteMarkedTexts(false);
+        }
+    if(options.s)
+        return serve(options.s,preambule);
+    if(options.b)
         {
-        struct wrec
-            {
-            const char * n;
-            const char * w;
-            void (*f)();
-            };
-        wrec wrecs[]=
-            {
-                {"1","F",setWeightAsFrequency},
-                {"2","L",setWeightAsLength},
-                {"3","FL",setWeightAsFrequencyTimesLength},
-                {"4","FL/wf",setWeightAsFrequencyTimesLengthTimesAverageOfInverseOfWordFrequency},
-                {"5","FLR",setWeightAsFrequencyTimesLengthTimesAllRatiosOfAverageWordFrequencyByRealWordFequency},
-                {"6","FLE",setWeightAsFrequencyTimesLengthTimesAverageOfEntropy},
-                {"7","FLElogL",setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength},
-                //setWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLengthTimesPhraseCountReduction();
-                {"8","FL/wfP",setWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction},
-                {"9","2005",setWeight2005},
-                {"10","2005b",setWeight2005b},
-                {0,0,0}
-            };
-        for(int i = 0;wrecs[i].n;++i)
-            {
-            if(!strcmp(wrecs[i].n,options.w) || !strcmp(wrecs[i].w,options.w))
-                {
-                setWeight = wrecs[i].f;
-                break;
-                }
+        FILE * fout = compressingStream(options.o ? fopen(options.o,"w") : stdout,method);
+        if(!fout)
+            {
+            printf("Cannot open %s for writing\n",options.o);
+            exit(-1);
+            }
+        int result = batch(options.b,fout);
+        if(fout != stdout)
+            fclose(fout);
+        return result;
+        }
+    char * pagePrefix = NULL;
+    if(options.g)
+        {
+        const char * comma = strchr(options.g,',');
+        size_t len = comma ? (size_t)(comma - options.g) : strlen(options.g);
+        pagePrefix = new char[len + 1];
+        strncpy(pagePrefix,options.g,len);
+        pagePrefix[len] = '\0';
+        setPhrasePages(pagePrefix,comma ? strtoul(comma + 1,NULL,10) : 0,options.o);
+        }
+
+    phraseTableFormat format = tsvTable;
+    bool typeNumbers = false;
+    if(options.t)
+        {
+        const char * comma = strchr(options.t,',');
+        size_t len = comma ? (size_t)(comma - options.t) : strlen(options.t);
+        if(len == 3 && !strncmp(options.t,"tsv",3))
+            format = tsvTable;
+        else if(len == 5 && !strncmp(options.t,"jsonl",5))
+            format = jsonlTable;
+        else if(len == 6 && !strncmp(options.t,"binary",6))
+            format = binaryTable;
+        else
+            {
+            printf("Unknown phrase table format %s\n",options.t);
+            exit(-1);
             }
+        typeNumbers = comma && !strcmp(comma + 1,"ids");
         }
 
     int N = argc - optind;
     double * versionalikeness = new double[N];
     ComputeRepetitiveness((const char **)(argv+optind),versionalikeness,options.letters);
     //WriteResults();
-    flagspreambule preambule;
-    preambule.allflags = 0;
-    preambule.bools.b_case_sensitive = true;
-    preambule.bools.b_formula = true;
-    preambule.bools.b_fuzzy = true;
-    preambule.bools.b_limit = true;
-    preambule.bools.b_passes = true;
-    preambule.bools.b_repetitiveness = true;
-    preambule.bools.b_task = true;
-    preambule.bools.b_weight = true;
     //printf("\nPhrases in file:%s\n",WritePhrases());
     FILE * fout = stdout;
     if(options.o)
@@ -3791,11 +5404,34 @@ int main(int argc, char ** argv)
             exit(-1);
             }
         }
+    fout = compressingStream(fout,method);
+    if(!fout)
+        {
+        printf("Cannot compress the output\n");
+        exit(-1);
+        }
     
     //WritePhrasesArg(options.letters,fout,preambule,/*b_phraseno*/false,/*b_realCount*/true,/*b_weight*/false, /*b_getAccumulatedRepetitiveness*/false);
-    WritePhrasesArgHTML(argv+optind,versionalikeness,options.letters,fout,preambule,/*b_phraseno*/false,/*b_realCount*/true,/*b_weight*/false, /*b_getAccumulatedRepetitiveness*/false);
+    if(spanIndex)
+        {
+        FILE * fidx = fopen(spanIndex,"wb");
+        if(!fidx)
+            {
+            printf("Cannot open %s for writing\n",spanIndex);
+            exit(-1);
+            }
+        WriteSpanIndex(fidx,binarySpanIndex);
+        fclose(fidx);
+        }
+    if(options.t)
+        WritePhraseTable(fout,format,typeNumbers);
+    else
+        WritePhrasesArgHTML(argv+optind,versionalikeness,options.letters,fout,preambule,/*b_phraseno*/false,/*b_realCount*/true,/*b_weight*/false, /*b_getAccumulatedRepetitiveness*/false);
     if(fout != stdout)
         fclose(fout);
+    EndAnalysis();
+    delete [] versionalikeness;
+    delete [] pagePrefix;
     return 0;
 }
 #endif
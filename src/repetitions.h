@@ -60,19 +60,42 @@ typedef union
     char allflags;
     } flagspreambule;
 
-extern charprop character[256];
-extern bool case_sensitive;
-extern bool versioncomparison;
-extern bool recursive;
-extern bool unlimited;
-extern int maxlimit;
-extern int minlimit;
+/* An analysis holds the texts, phrases and rankings of a ComputeRepetitiveness
+and the settings for it. Each thread has a current analysis, at first a default
+one that is shared by all threads. The functions below without an analysis
+argument work on the current analysis of the calling thread. Different
+analyses can run concurrently. */
+class analysis;
+analysis * NewAnalysis(); // with a copy of the settings of the current analysis
+void DeleteAnalysis(analysis * A);
+void CopySettings(analysis * to,const analysis * from); // NULL: the default analysis
+analysis * UseAnalysis(analysis * A); // makes A current in this thread, NULL: the default. Returns the previous.
+
+/* A text in memory. It is tokenized and rendered where it is, so it must stay
+put until EndAnalysis. */
+typedef struct textInput
+    {
+    const char * name; // shown in the output
+    const char * text; // need not be zero terminated
+    size_t length;
+    } textInput;
 
 void fill_character_properties(void);
 void ShiftToNextProp(int i);
-double ComputeRepetitiveness(char ** sis,double * versionalikeness,bool morphemes);
+/* Reads the files sis and writes each marked text to <file>.html. */
+double ComputeRepetitiveness(const char ** sis,double * versionalikeness,bool morphemes);
+double ComputeRepetitiveness(analysis * A,const char ** sis,double * versionalikeness,bool morphemes);
+/* Reads the texts from memory and writes nothing. See WriteTextWithMarkings(int,FILE*). */
+double ComputeRepetitiveness(const textInput * texts,int ntexts,double * versionalikeness);
+double ComputeRepetitiveness(analysis * A,const textInput * texts,int ntexts,double * versionalikeness);
+void EndAnalysis(); // releases all that ComputeRepetitiveness allocated, but keeps some memory for the next
+void EndAnalysis(analysis * A);
 
-char ** WriteTextWithMarkings();
+char ** WriteTextWithMarkings(); // to <file>.html, or as set by setMarkedOutput. Returns the file names
+bool WriteTextWithMarkings(int fileno,FILE * fp); // the marked text of text fileno as HTML, false if it could not be written
+bool WriteTextWithMarkings(FILE * fp); // all marked texts in one HTML document
+void DeleteMarkedFileNames(char ** names); // what WriteTextWithMarkings() returned
+bool WriteTextWithMarkings(analysis * A,int fileno,FILE * fp);
 //char * WritePhrases();
 void WritePhrasesArgHTML
         (char ** names
@@ -86,6 +109,38 @@ void WritePhrasesArgHTML
         ,bool b_getAccumulatedRepetitiveness
         );
 
+/* Machine readable phrase tables, see WritePhraseTable. Numbers are written
+with six decimals in text and as little endian in binary. */
+enum phraseTableFormat
+    {tsvTable    // a header line, then rank, count, weight, accumulated repetitiveness, phrase
+    ,jsonlTable  // {"rank":..,"count":..,"weight":..,"accumulated":..,"words":[..]}
+    ,binaryTable // "RPW1" ("RPT1" with type numbers), then per phrase rank, count (uint32),
+                 // weight, accumulated repetitiveness (double), length (uint32) and
+                 // per word its length (uint32) and bytes, or its type number (uint32)
+    };
+/* Writes the repeated phrases of the ranking, highest ranked first. With
+typeNumbers, phrases are written as type numbers (see GetTypeName) instead of
+words and "words" is "types" in the JSON records. */
+void WritePhraseTable(FILE * fp,phraseTableFormat format,bool typeNumbers);
+const char * GetTypeName(unsigned long typeNumber); // NULL if there is no such type
+
+/* Writes where the marked texts have their spans, so that render (see
+render.h) can write the marked texts later, for only the texts that are
+needed. As text,
+
+    # encoding<tab>UTF-8 (or ISO-8859-1)
+    # file<tab><end of the last token><tab><name>     for each text with tokens
+    file<tab>start<tab>end<tab>rank<tab>joined
+    <name><tab><start><tab><end><tab><rank><tab><joined>  for each span
+
+or binary, "RPS1", UTF-8 (uint32), the number of texts (uint32) and for each
+text the end of its last token (uint64), the length of its name (uint32) and
+the name, then for each span the number of its text (uint32), start, end
+(uint64), rank and joined (uint32). Start and end are byte offsets in the text.
+The rank is that of the phrase in WritePhraseTable, 0 if not known. Joined is 1
+if the span follows the previous one without a word in between. */
+void WriteSpanIndex(FILE * fp,bool binary);
+
 unsigned long GetLowestfreq();
 unsigned long GetHighestfreq();
 ptrdiff_t GetNumberOfTokens();
@@ -99,6 +154,21 @@ unsigned long GetHighestfreq(const char ** type);
 size_t GetFiducialTextLength();
 size_t GetReducedTextLength();
 unsigned long GetRealUnmatched();
+/* The repeated phrase with the given rank, 0 being the highest. Writes its
+words to words, truncated to size. Returns its count, 0 if there are fewer
+repeated phrases. */
+unsigned long GetRepeatedPhrase(unsigned long rank,char * words,size_t size);
+ptrdiff_t GetNumberOfTokens(analysis * A);
+ptrdiff_t GetNumberOfTokensFile(analysis * A,int fileno);
+unsigned long GetNumberOfSentenceSeparatorsFile(analysis * A,int fileno);
+unsigned long GetRealUnmatchedFile(analysis * A,int fileno);
+unsigned long GetNumberOfTypes(analysis * A);
+unsigned long GetLowestfreq(analysis * A,const char ** type);
+unsigned long GetHighestfreq(analysis * A,const char ** type);
+size_t GetFiducialTextLength(analysis * A);
+size_t GetReducedTextLength(analysis * A);
+unsigned long GetRealUnmatched(analysis * A);
+int GetNumberOfRankings(analysis * A);
 void chooseWeightAsFrequency();
 void chooseWeightAsLength();
 void chooseWeightAsFrequencyTimesLength();
@@ -110,10 +180,32 @@ void chooseWeightAsFrequencyTimesLengthTimesAverageOfEntropyTimesLogLength();
 void chooseWeightAsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCountReduction();
 void chooseWeightAs2005();
 void chooseWeightAs2005b();
+int chooseWeights(const char * list); // "9", "2005", "1,4,9" or "all". Returns number of weights.
+int GetNumberOfRankings(); // one per weight and fuzzy match level chosen
+void selectRanking(int i); // ranking for Get*, WriteTextWithMarkings, default 0
+void setVersionComparison(bool flag); // true: the texts are versions of one text
+void setCaseSensitive(bool flag);
+/* NULL (default): WriteTextWithMarkings() writes each text to <file>.html.
+Otherwise it writes all to the file name, which must stay valid. */
+void setMarkedOutput(const char * name);
+void setWriteMarkedTexts(bool flag); // false: ComputeRepetitiveness(sis,...) writes no marked texts
+/* "gzip" or "zstd": the marked texts are written compressed, to
+<file>.html.gz or <file>.html.zst. NULL (default): uncompressed. Returns false
+if the compression is unknown or not built in. */
+bool setCompression(const char * method);
+/* With a prefix, the final recount writes the repeated phrases of each ranking
+to pages <prefix>-<ranking>-<page>.html of rowsPerPage (0: 1000) rows, while it
+goes on, and WritePhrasesArgHTML links to the pages instead of writing the
+tables. The links are relative to the directory of index, the file that
+WritePhrasesArgHTML writes (NULL: the working directory). prefix and index must
+stay valid. NULL prefix (default): no pages. */
+void setPhrasePages(const char * prefix,unsigned long rowsPerPage,const char * index);
 void setUnlimited(bool flag,int editMaxLimit);
 void setMaxLimit(int limit);
 void setMinLimit(int limit);
 void setRecursion(int npasses);
+void setTopK(unsigned long K); // rank only until K repeated phrases are found. 0: all
+bool repetitivenessIsApproximate(); // true if setTopK left phrases out
 bool weightIsFrequency();
 bool weightIsLength();
 bool weightIsFrequencyTimesLength();
@@ -126,6 +218,7 @@ bool weightIsFrequencyTimesLengthTimesAverageOfInverseWordFrequencyTimesPhraseCo
 bool weightIs2005();
 bool weightIs2005b();
 void selectFuzzynessBoundary(int perc);
+int chooseFuzzynessBoundaries(const char * list); // "85" or "100,95,85,75,50". Returns number of levels.
 int currentFuzzynessBoundary();
 
 #define ALLOWONEWORDPHRASES
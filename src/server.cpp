@@ -0,0 +1,444 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "server.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <new>
+
+/* A stream of requests and answers. Answers are written whole, one at a
+time. */
+class connection
+    {
+    FILE * in;
+    int out;
+    bool own; // close in and out when done
+    std::mutex writing;
+public:
+    connection(int in,int out,bool own):in(fdopen(in,"rb")),out(out),own(own)
+        {
+        if(!this->in && own)
+            { // nothing can be read, nor answered
+            close(in);
+            if(out != in)
+                close(out);
+            this->own = false;
+            }
+        }
+    ~connection()
+        {
+        if(own)
+            {
+            if(out != fileno(in))
+                close(out);
+            fclose(in);
+            }
+        }
+    FILE * input() // NULL if the connection could not be opened
+        {
+        return in;
+        }
+    void answer(const char * head,const char * body,size_t length)
+        {
+        std::lock_guard<std::mutex> lock(writing);
+        if(writeAll(head,strlen(head)))
+            writeAll(body,length);
+        }
+private:
+    bool writeAll(const char * data,size_t length)
+        {
+        while(length > 0)
+            {
+            ssize_t n = write(out,data,length);
+            if(n < 0)
+                {
+                if(errno == EINTR)
+                    continue;
+                return false;
+                }
+            data += n;
+            length -= n;
+            }
+        return true;
+        }
+    };
+
+typedef struct request
+    {
+    std::shared_ptr<connection> from;
+    char * id;
+    char * options;
+    int ntexts;
+    textInput * texts;
+    char ** names; // NULL terminated, for WritePhrasesArgHTML
+    size_t bytes; // of text
+    request():id(NULL),options(NULL),ntexts(0),texts(NULL),names(NULL),bytes(0)
+        {
+        }
+    ~request()
+        {
+        for(int i = 0;i < ntexts;++i)
+            {
+            delete [] texts[i].text;
+            delete [] names[i];
+            }
+        delete [] texts;
+        delete [] names;
+        free(id);
+        }
+    } request;
+
+static std::mutex queueLock;
+static std::condition_variable queueChanged; // for the workers
+static std::condition_variable queueRoom; // for the readers
+static std::deque<request *> queue;
+static size_t queuedBytes = 0;
+static bool closed = false; // no more requests will come
+static flagspreambule Preambule;
+
+/* Waits until the queue has room for R, so that the readers stop reading
+while the workers are behind. A request always fits in an empty queue. */
+static void push(request * R)
+    {
+    std::unique_lock<std::mutex> lock(queueLock);
+    while(  !queue.empty()
+         && (  queue.size() >= MAXQUEUEDREQUESTS
+            || queuedBytes + R->bytes > MAXQUEUEDBYTES
+            )
+         )
+        queueRoom.wait(lock);
+    queue.push_back(R);
+    queuedBytes += R->bytes;
+    queueChanged.notify_one();
+    }
+
+static request * pop()
+    {
+    std::unique_lock<std::mutex> lock(queueLock);
+    while(queue.empty() && !closed)
+        queueChanged.wait(lock);
+    if(queue.empty())
+        return NULL;
+    request * R = queue.front();
+    queue.pop_front();
+    queuedBytes -= R->bytes;
+    queueRoom.notify_all();
+    return R;
+    }
+
+static void error(const std::shared_ptr<connection> & to,const char * id,const char * message)
+    {
+    char head[1000];
+    snprintf(head,sizeof(head),"%s ERROR %s\n",id,message);
+    to->answer(head,"",0);
+    }
+
+/* Answers R with an error and drops it. Returns NULL, so that no more is read
+from the connection. */
+static request * refuse(request * R,const char * message)
+    {
+    error(R->from,R->id,message);
+    delete R;
+    return NULL;
+    }
+
+/* Reads one request. Returns NULL at the end of the input, or if the request
+is refused. */
+static request * readRequest(const std::shared_ptr<connection> & from)
+    {
+    char * line = NULL;
+    size_t size = 0;
+    if(getline(&line,&size,from->input()) < 0)
+        {
+        free(line);
+        return NULL;
+        }
+    request * R = new request;
+    R->from = from;
+    R->id = line;
+    char * rest = line + strcspn(line," \r\n");
+    if(*rest)
+        *rest++ = '\0';
+    int ntexts = (int)strtol(rest,&R->options,10);
+    R->options[strcspn(R->options,"\r\n")] = '\0';
+    if(ntexts > MAXREQUESTTEXTS)
+        return refuse(R,"too many texts");
+    R->texts = new (std::nothrow) textInput[ntexts > 0 ? ntexts : 0];
+    R->names = new (std::nothrow) char * [ntexts > 0 ? ntexts + 1 : 1];
+    if(!R->texts || !R->names)
+        return refuse(R,"out of memory");
+    R->names[0] = NULL;
+    size_t total = 0;
+    char * textLine = NULL;
+    size_t textLineSize = 0;
+    for(;R->ntexts < ntexts;++R->ntexts)
+        {
+        if(getline(&textLine,&textLineSize,from->input()) < 0)
+            break;
+        char * name;
+        size_t length = strtoul(textLine,&name,10);
+        name += strspn(name," ");
+        name[strcspn(name,"\r\n")] = '\0';
+        if(length > MAXREQUESTBYTES - total)
+            {
+            free(textLine);
+            return refuse(R,"request too large");
+            }
+        total += length;
+        char * text = new (std::nothrow) char[length > 0 ? length : 1];
+        char * nameCopy = text ? new (std::nothrow) char[strlen(name) + 1] : NULL;
+        if(!nameCopy)
+            {
+            delete [] text;
+            free(textLine);
+            return refuse(R,"out of memory");
+            }
+        if(fread(text,1,length,from->input()) != length)
+            {
+            delete [] text;
+            delete [] nameCopy;
+            break;
+            }
+        strcpy(nameCopy,name);
+        R->names[R->ntexts] = nameCopy;
+        R->names[R->ntexts + 1] = NULL;
+        R->texts[R->ntexts].name = R->names[R->ntexts];
+        R->texts[R->ntexts].text = text;
+        R->texts[R->ntexts].length = length;
+        R->bytes += length;
+        }
+    free(textLine);
+    if(R->ntexts < ntexts)
+        { // the input ended in the middle of the request
+        delete R;
+        return NULL;
+        }
+    return R;
+    }
+
+static void readRequests(std::shared_ptr<connection> from)
+    {
+    if(!from->input())
+        {
+        perror("fdopen");
+        return;
+        }
+    request * R;
+    while((R = readRequest(from)) != NULL)
+        push(R);
+    }
+
+/* Applies the options of a request to the current analysis. Returns an error
+message or NULL. */
+static const char * applyOptions(char * options)
+    {
+    char * option;
+    char * save = NULL;
+    while((option = strtok_r(options," \t",&save)) != NULL)
+        {
+        options = NULL;
+        char * value = strtok_r(NULL," \t",&save);
+        if(!value || option[0] != '-' || !option[1] || option[2])
+            return "bad option";
+        switch(option[1])
+            {
+            case 'w':
+                if(chooseWeights(value) == 0)
+                    return "unknown weight";
+                break;
+            case 'p':
+                setRecursion(strcmp(value,"1") ? 2 : 1);
+                break;
+            case 'f':
+                if(chooseFuzzynessBoundaries(value) == 0)
+                    return "unknown fuzzy match level";
+                break;
+            case 'k':
+                setTopK(strtoul(value,NULL,10));
+                break;
+            case 'm':
+                setMinLimit(atoi(value));
+                break;
+            case 'M':
+                setMaxLimit(atoi(value));
+                break;
+            default:
+                return "unknown option";
+            }
+        }
+    return NULL;
+    }
+
+static void answer(request * R)
+    {
+    const char * message = R->ntexts < 1 ? "no texts" : applyOptions(R->options);
+    if(message)
+        {
+        error(R->from,R->id,message);
+        return;
+        }
+    setVersionComparison(R->ntexts > 1);
+    double * versionalikeness = new double[R->ntexts];
+    double repetitiveness = ComputeRepetitiveness(R->texts,R->ntexts,versionalikeness);
+    char * body = NULL;
+    size_t length = 0;
+    FILE * fp = open_memstream(&body,&length);
+    WritePhrasesArgHTML(R->names,versionalikeness,false,fp,Preambule,/*b_phraseno*/false,/*b_realCount*/true,/*b_weight*/false,/*b_getAccumulatedRepetitiveness*/false);
+    fclose(fp);
+    char head[1000];
+    snprintf(head,sizeof(head),"%s OK %f %lu %s\n",R->id,repetitiveness,(unsigned long)length,repetitivenessIsApproximate() ? "lower-bound" : "exact");
+    R->from->answer(head,body,length);
+    free(body);
+    delete [] versionalikeness;
+    }
+
+/* Each worker has an analysis of its own, which keeps its memory from one
+request to the next. */
+static void work()
+    {
+    analysis * A = NewAnalysis();
+    UseAnalysis(A);
+    request * R;
+    while((R = pop()) != NULL)
+        {
+        CopySettings(A,NULL);
+        answer(R);
+        EndAnalysis();
+        delete R;
+        }
+    UseAnalysis(NULL);
+    DeleteAnalysis(A);
+    }
+
+static std::mutex connectionsLock;
+static std::condition_variable connectionEnded;
+static int connections = 0; // that are being read
+
+static void acceptConnections(int listener)
+    {
+    for(;;)
+        {
+            {
+            std::unique_lock<std::mutex> lock(connectionsLock);
+            while(connections >= MAXCONNECTIONS)
+                connectionEnded.wait(lock);
+            }
+        int fd = accept(listener,NULL,NULL);
+        if(fd < 0)
+            {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            break;
+            }
+            {
+            std::lock_guard<std::mutex> lock(connectionsLock);
+            ++connections;
+            }
+        std::thread([fd]()
+            {
+            readRequests(std::make_shared<connection>(fd,fd,true));
+            std::lock_guard<std::mutex> lock(connectionsLock);
+            --connections;
+            connectionEnded.notify_one();
+            }).detach();
+        }
+    }
+
+static void closeQueue()
+    {
+    std::lock_guard<std::mutex> lock(queueLock);
+    closed = true;
+    queueChanged.notify_all();
+    }
+
+int serve(const char * address,flagspreambule preambule)
+    {
+    Preambule = preambule;
+    signal(SIGPIPE,SIG_IGN); // a client that goes away must not stop the server
+    std::thread reader;
+    if(!strcmp(address,"-"))
+        {
+        reader = std::thread([]()
+            {
+            readRequests(std::make_shared<connection>(fileno(stdin),fileno(stdout),false));
+            closeQueue();
+            });
+        }
+    else
+        {
+        struct sockaddr_un name;
+        memset(&name,0,sizeof(name));
+        name.sun_family = AF_UNIX;
+        if(strlen(address) >= sizeof(name.sun_path))
+            {
+            fprintf(stderr,"Socket path %s is too long\n",address);
+            return 1;
+            }
+        strcpy(name.sun_path,address);
+        struct stat st;
+        if(lstat(address,&st) == 0)
+            {
+            if(!S_ISSOCK(st.st_mode))
+                {
+                fprintf(stderr,"%s exists and is not a socket\n",address);
+                return 1;
+                }
+            unlink(address); // left by an earlier server
+            }
+        int listener = socket(AF_UNIX,SOCK_STREAM,0);
+        if(  listener < 0
+          || bind(listener,(struct sockaddr *)&name,sizeof(name)) < 0
+          || listen(listener,SOMAXCONN) < 0
+          )
+            {
+            perror(address);
+            return 1;
+            }
+        reader = std::thread([listener]()
+            {
+            acceptConnections(listener);
+            closeQueue();
+            });
+        }
+    // The workers run as the slices of a parallelFor, so that the analyses
+    // do not start threads of their own.
+    parallelFor(numberOfThreads(),1,[](unsigned long,unsigned long)
+        {
+        work();
+        });
+    reader.join();
+    return 0;
+    }
@@ -0,0 +1,70 @@
+/*
+Repetitiveness checker
+
+Copyright (C) 2020  Center for Sprogteknologi, University of Copenhagen
+
+This file is part of CST's Language Technology Tools.
+
+REPETITIVENESS CHECKER is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+REPETITIVENESS CHECKER is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with REPETITIVENESS CHECKER; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "repetitions.h"
+
+#define MAXREQUESTTEXTS 100000 // texts in one request
+#define MAXREQUESTBYTES (1UL << 30) // bytes of text in one request
+#define MAXQUEUEDREQUESTS 64 // requests waiting for a worker
+#define MAXQUEUEDBYTES (1UL << 31) // bytes of text waiting for a worker
+#define MAXCONNECTIONS 64 // connections that are read at the same time
+
+/* Answers analysis requests until the input ends, which for a socket is
+never. address is the path of a Unix domain socket, or "-" for standard
+input and output. The requests are analysed concurrently, each by one of
+numberOfThreads() workers. The settings of the default analysis are the
+defaults for the requests. Returns the exit code.
+
+A request is a line
+
+    <id> <number of texts> [<option> <value> ...]
+
+followed by, for each text, a line
+
+    <length> <name>
+
+and <length> bytes of text. The options are -w, -p, -f and -k as on the
+command line and -m and -M for the minimum and maximum number of words in
+a phrase. The answer is a line
+
+    <id> OK <repetitiveness> <length> <bound>
+
+followed by <length> bytes of HTML with the phrase table. <bound> is "exact",
+or "lower-bound" if -k left phrases uncounted, in which case the
+repetitiveness and the alikeness in the HTML are lower bounds. An error is
+answered with a line
+
+    <id> ERROR <message>
+
+Answers on one connection come in the order in which they are ready, not
+necessarily in the order of the requests. A request with more than
+MAXREQUESTTEXTS texts or MAXREQUESTBYTES bytes of text, or one that does not
+fit in memory, is answered with ERROR and ends the connection. While
+MAXQUEUEDREQUESTS requests or MAXQUEUEDBYTES bytes of text wait for a worker,
+no further requests are read, and no more than MAXCONNECTIONS connections are
+read at the same time. */
+int serve(const char * address,flagspreambule preambule);
+
+#endif